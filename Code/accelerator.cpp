@@ -0,0 +1,47 @@
+#include <stdio.h>
+
+#include "accelerator.h"
+#include "sceneFile.h"
+
+// Saved structure: an AccelFileHeader, then the data of the structure (see SaveData()). The
+// header ties the file to the content hash of the scene, so an edited scene gets a new build.
+
+#define ACCEL_FILE_MAGIC 0x43413350   // "P3AC"
+#define ACCEL_FILE_VERSION 1
+
+struct AccelFileHeader {
+	uint32_t magic, version;
+	uint32_t tag;          // structure and settings, see fileTag()
+	uint32_t numPrimitives;
+	uint64_t sceneHash;
+};
+
+bool Accelerator::Save(const char* name)
+{
+	FILE* file = fopen(name, "wb");
+	if (file == NULL) return false;
+
+	AccelFileHeader h = { ACCEL_FILE_MAGIC, ACCEL_FILE_VERSION, fileTag(), (uint32_t)scene->getNumPrimitives(), scene->getContentHash() };
+	AccelWriter out(file);
+	out.write(h);
+	SaveData(out);
+
+	bool ok = fclose(file) == 0 && out.ok;
+	if (!ok) remove(name);   // no partial file for the next run to read
+	return ok;
+}
+
+bool Accelerator::Load(const char* name)
+{
+	MappedFile file;
+	if (!file.Open(name)) return false;
+
+	AccelReader in(file.data, file.size);
+	AccelFileHeader h;
+	in.read(h);
+	if (!in.ok || h.magic != ACCEL_FILE_MAGIC || h.version != ACCEL_FILE_VERSION || h.tag != fileTag() ||
+		h.numPrimitives != (uint32_t)scene->getNumPrimitives() || h.sceneHash != scene->getContentHash())
+		return false;
+
+	return LoadData(in) && in.ok && in.atEnd();
+}
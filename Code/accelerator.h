@@ -0,0 +1,145 @@
+#ifndef ACCELERATOR_H
+#define ACCELERATOR_H
+
+#include <stdio.h>
+#include <string.h>
+#include "scene.h"
+#include "rayKernels.h"
+#include "stats.h"
+#include "threadPool.h"
+
+// Sequential writing and reading of the data of a saved structure: values as they are in memory,
+// and arrays as a 64-bit count followed by their elements. ok turns false at the first error,
+// or when the data runs out.
+class AccelWriter
+{
+public:
+	AccelWriter(FILE* a_File) : ok(true), file(a_File) {}
+
+	template <typename T> void write(const T& value) { ok = ok && fwrite(&value, sizeof(T), 1, file) == 1; }
+	template <typename T> void writeArray(const vector<T>& v)
+	{
+		uint64_t n = v.size();
+		write(n);
+		ok = ok && (n == 0 || fwrite(v.data(), sizeof(T), n, file) == n);
+	}
+
+	bool ok;
+
+private:
+	FILE* file;
+};
+
+class AccelReader
+{
+public:
+	AccelReader(const char* a_Data, size_t a_Size) : ok(true), data(a_Data), size(a_Size), offset(0) {}
+
+	template <typename T> void read(T& value)
+	{
+		ok = ok && size - offset >= sizeof(T);
+		if (!ok) return;
+		memcpy((void*)&value, data + offset, sizeof(T));
+		offset += sizeof(T);
+	}
+	template <typename T> void readArray(vector<T>& v)
+	{
+		uint64_t n = 0;
+		read(n);
+		ok = ok && n <= (size - offset) / sizeof(T);
+		if (!ok) return;
+		v.resize(n);
+		if (n > 0) memcpy((void*)v.data(), data + offset, n * sizeof(T));
+		offset += n * sizeof(T);
+	}
+	bool atEnd() { return offset == size; }
+
+	bool ok;
+
+private:
+	const char* data;
+	size_t size, offset;
+};
+
+// Common interface of the ray acceleration structures (uniform Grid, BVH)
+
+class Accelerator
+{
+public:
+	// The structure is built with the threads of pool, or on the calling thread without one, by
+	// Build(); or it is read back by Load() from a file written by Save() for the same scene
+	Accelerator(Scene* a_Scene, ThreadPool* a_Pool = NULL) : scene(a_Scene), pool(a_Pool) {}
+	virtual ~Accelerator() {}
+
+	virtual void Build() = 0;
+	bool Save(const char* name);
+	bool Load(const char* name);   // false if the file is missing, or was written for another scene or structure
+
+	virtual bool Traverse(Ray& ray, HitRecord& hit) = 0;   // closest hit, completed by Scene::CompleteHit()
+	// True if the ray hits anything nearer than tmax, such as the distance to a light. The
+	// traversal returns at the first blocker found and goes no further than tmax.
+	virtual bool Occluded(Ray& ray, float tmax) = 0;
+
+	// Packets of up to PACKET_SIZE coherent rays, such as the primary rays of a block of pixels:
+	// the same results as Traverse() and Occluded() for every ray. By default the rays are
+	// traced one at a time.
+	virtual void TraversePacket(Ray* rays, int count, HitRecord* hits, bool* hit)
+	{
+		for (int i = 0; i < count; i++)
+			hit[i] = Traverse(rays[i], hits[i]);
+	}
+
+	virtual void OccludedPacket(Ray* rays, const float* tmax, int count, bool* occluded)
+	{
+		for (int i = 0; i < count; i++)
+			occluded[i] = Occluded(rays[i], tmax[i]);
+	}
+
+protected:
+	Scene* scene;
+	ThreadPool* pool;
+
+	// Saved data: the tag tells the structures and their settings apart in the file header,
+	// LoadData() reads back what SaveData() wrote
+	virtual uint32_t fileTag() = 0;
+	virtual void SaveData(AccelWriter& out) = 0;
+	virtual bool LoadData(AccelReader& in) = 0;
+
+	void parallelFor(int count, function<void(int begin, int end)> body)
+	{
+		if (pool != NULL) pool->parallelFor(count, body);
+		else if (count > 0) body(0, count);
+	}
+
+	// The primitives without a bounding box (planes) are kept out of the structure, so that its
+	// bounds and cells only cover the finite geometry, and are intersected once per ray instead.
+	// objects gets the bounded ones.
+	vector<PrimRef> unbounded;
+
+	void SplitPrimitives(vector<PrimRef>& objects)
+	{
+		const vector<PrimRef>& primitives = scene->getPrimitives();
+		objects.clear();
+		unbounded.clear();
+		for (size_t i = 0; i < primitives.size(); i++)
+			(scene->isBounded(primitives[i]) ? objects : unbounded).push_back(primitives[i]);
+	}
+
+	// closest hit nearer than t with the unbounded primitives, as Scene::Intersect()
+	bool IntersectUnbounded(Ray& ray, float& t, PrimRef& hit)
+	{
+		if (unbounded.empty()) return false;
+		RayStats::local().objectTests += unbounded.size();
+		return scene->Intersect(unbounded.data(), unbounded.size(), ray, t, hit);
+	}
+
+	bool OccludedUnbounded(Ray& ray, float tmax)
+	{
+		if (unbounded.empty()) return false;
+		RayStats& stats = RayStats::local();
+		stats.objectTests += unbounded.size();
+		stats.shadowTests += unbounded.size();
+		return scene->Occluded(unbounded.data(), unbounded.size(), ray, tmax);
+	}
+};
+#endif
@@ -1,18 +1,22 @@
-
-#include "vector.h"
-#include "ray.h"
-
-class AABB
-{
-public:
-	Vector min, max;
-
-	AABB(void);
-	virtual ~AABB();
-	AABB(const Vector& v0, const Vector& v1);
-	AABB(const AABB& bbox);
-	AABB operator= (const AABB& rhs);
-	
-	bool intercepts(const Ray& r, float& t0, float& t1, Vector& tmin, Vector& tmax);
-	bool isInside(const Vector& p);
-};
\ No newline at end of file
+#ifndef BOUNDINGBOX_H
+#define BOUNDINGBOX_H
+
+
+#include "vector.h"
+#include "ray.h"
+
+class AABB
+{
+public:
+	Vector min, max;
+
+	AABB(void);
+	virtual ~AABB();
+	AABB(const Vector& v0, const Vector& v1);
+	AABB(const AABB& bbox);
+	AABB operator= (const AABB& rhs);
+	
+	bool intercepts(const Ray& r, float& t0, float& t1, Vector& tmin, Vector& tmax) const;
+	bool isInside(const Vector& p) const;
+};
+#endif
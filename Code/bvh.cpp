@@ -0,0 +1,615 @@
+#include <iostream>
+#include <algorithm>
+#include <mutex>
+
+#include "bvh.h"
+#include "maths.h"
+#include "stats.h"
+#include "rayKernels.h"
+
+#define BVH_MAX_DEPTH 64   // also the size of the traversal stack
+#define BVH_TASK_SIZE 1024   // subtrees of at most this many objects are built by one thread
+
+static float axisOf(const Vector& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static void growBounds(Vector& min, Vector& max, const Vector& p)
+{
+	if (p.x < min.x) min.x = p.x;
+	if (p.y < min.y) min.y = p.y;
+	if (p.z < min.z) min.z = p.z;
+	if (p.x > max.x) max.x = p.x;
+	if (p.y > max.y) max.y = p.y;
+	if (p.z > max.z) max.z = p.z;
+}
+
+static inline float minf(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float maxf(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+static float surfaceArea(const Vector& min, const Vector& max)
+{
+	float dx = max.x - min.x, dy = max.y - min.y, dz = max.z - min.z;
+	if (dx < 0 || dy < 0 || dz < 0) return 0.0f;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+BVH::BVH(Scene* a_Scene, ThreadPool* a_Pool) : Accelerator(a_Scene, a_Pool)
+{
+	SplitPrimitives(objects);
+}
+
+int BVH::getNumObjects()
+{
+	return objects.size();
+}
+
+const PrimRef& BVH::getObject(unsigned int index)
+{
+	return objects[index];
+}
+
+int BVH::getNumNodes()
+{
+	return nodes.size();
+}
+
+// With several threads, the top of the tree is built on the calling thread, with the bounds and
+// bins of its large nodes computed by the pool. The subtrees below it, of at most BVH_TASK_SIZE
+// objects, are built one per task into nodes of their own, which are then appended in order: the
+// tree is the same whatever the number of threads, only laid out differently from the serial one.
+void BVH::Build()
+{
+	int n = getNumObjects();
+	vector<BuildObject> build(n);
+
+	parallelFor(n, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			AABB box = scene->GetBoundingBox(objects[i]);
+			build[i].min = box.min;
+			build[i].max = box.max;
+			build[i].centroid = (box.min + box.max) * 0.5f;
+			build[i].object = objects[i];
+		}
+		});
+
+	nodes.clear();
+	if (n == 0) return;
+
+	nodes.reserve(2 * n);
+	nodes.push_back(BVHNode());
+	vector<Subtree> subtrees;
+	bool parallel = pool != NULL && pool->getNumThreads() > 1;
+	Subdivide(build, nodes, 0, 0, n, 0, parallel ? &subtrees : NULL);
+
+	vector<vector<BVHNode> > subNodes(subtrees.size());
+	parallelFor(subtrees.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			subNodes[i].reserve(2 * subtrees[i].count);
+			subNodes[i].push_back(BVHNode());
+			Subdivide(build, subNodes[i], 0, subtrees[i].first, subtrees[i].count, subtrees[i].depth, NULL);
+		}
+		});
+
+	// the root of a subtree goes to the node that left it, its other nodes after the last one
+	for (size_t i = 0; i < subtrees.size(); i++) {
+		int offset = nodes.size() - 1;
+		for (size_t j = 0; j < subNodes[i].size(); j++) {
+			BVHNode node = subNodes[i][j];
+			if (node.count == 0) node.index += offset;
+			if (j == 0)
+				nodes[subtrees[i].node] = node;
+			else
+				nodes.push_back(node);
+		}
+	}
+
+	// group the objects of every leaf by set, for Scene::Intersect()
+	parallelFor(nodes.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			if (nodes[i].count > 0) {
+				for (int j = nodes[i].index; j < nodes[i].index + nodes[i].count; j++)
+					objects[j] = build[j].object;
+				stable_sort(&objects[nodes[i].index], &objects[nodes[i].index] + nodes[i].count);
+			}
+		});
+}
+
+uint32_t BVH::fileTag()
+{
+	return 0x20485642;   // "BVH "
+}
+
+// The build settings are saved too: a file written with other ones is built again
+void BVH::SaveData(AccelWriter& out)
+{
+	out.write((int)BVH_BINS);
+	out.write((int)BVH_MAX_LEAF);
+	out.writeArray(objects);
+	out.writeArray(nodes);
+}
+
+static bool lessRef(const PrimRef& a, const PrimRef& b)
+{
+	return a.set != b.set ? a.set < b.set : a.prim < b.prim;
+}
+
+// The saved objects must be the bounded primitives of the scene in another order, every node
+// must point inside the arrays, and the tree must be no deeper than the traversal stacks allow
+bool BVH::LoadData(AccelReader& in)
+{
+	int bins = 0, maxLeaf = 0;
+	vector<PrimRef> o;
+	vector<BVHNode> t;
+
+	in.read(bins);
+	in.read(maxLeaf);
+	in.readArray(o);
+	in.readArray(t);
+	if (!in.ok || bins != BVH_BINS || maxLeaf != BVH_MAX_LEAF || o.size() != objects.size() || (t.empty() != o.empty()))
+		return false;
+
+	vector<PrimRef> a = o, b = objects;
+	sort(a.begin(), a.end(), lessRef);
+	sort(b.begin(), b.end(), lessRef);
+	for (size_t i = 0; i < a.size(); i++)
+		if (a[i].set != b[i].set || a[i].prim != b[i].prim) return false;
+
+	// children come after their parent, so one pass in order reaches every node from the root
+	// once, with its depth; the leaves are at most at BVH_MAX_DEPTH - 1, as Subdivide() leaves them
+	vector<int> depth(t.size(), -1);
+	if (!t.empty()) depth[0] = 0;
+	for (size_t i = 0; i < t.size(); i++) {
+		if (depth[i] < 0 || t[i].count < 0 || t[i].index < 0) return false;
+		if (t[i].count > 0) {
+			if ((size_t)t[i].index + t[i].count > o.size()) return false;
+			continue;
+		}
+		size_t left = t[i].index;
+		if (left <= i || left + 1 >= t.size() || depth[left] >= 0 || depth[left + 1] >= 0 || depth[i] + 1 > BVH_MAX_DEPTH - 1)
+			return false;
+		depth[left] = depth[left + 1] = depth[i] + 1;
+	}
+
+	objects.swap(o);
+	nodes.swap(t);
+	return true;
+}
+
+// Bounds of the boxes and of the centroids of count objects, grown into bmin, bmax, cmin and cmax
+static void objectBounds(const BVH::BuildObject* b, int count, Vector& bmin, Vector& bmax, Vector& cmin, Vector& cmax)
+{
+	for (int i = 0; i < count; i++) {
+		growBounds(bmin, bmax, b[i].min);
+		growBounds(bmin, bmax, b[i].max);
+		growBounds(cmin, cmax, b[i].centroid);
+	}
+}
+
+// Builds into tree, the nodes or those of a subtree (see Build()): with subtrees given, the nodes of at
+// most BVH_TASK_SIZE objects go to that list instead of being subdivided, and the large ones have
+// their bounds and bins computed in parallel.
+void BVH::Subdivide(vector<BuildObject>& build, vector<BVHNode>& tree, int node, int first, int count, int depth, vector<Subtree>* subtrees)
+{
+	if (subtrees != NULL && count <= BVH_TASK_SIZE) {
+		subtrees->push_back({ node, first, count, depth });
+		return;
+	}
+
+	Vector bmin = Vector(FLT_MAX, FLT_MAX, FLT_MAX), bmax = Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	Vector cmin = bmin, cmax = bmax;
+
+	if (subtrees != NULL) {
+		mutex lock;
+		parallelFor(count, [&](int begin, int end) {
+			Vector b0 = Vector(FLT_MAX, FLT_MAX, FLT_MAX), b1 = Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			Vector c0 = b0, c1 = b1;
+			objectBounds(&build[first + begin], end - begin, b0, b1, c0, c1);
+
+			lock_guard<mutex> guard(lock);
+			growBounds(bmin, bmax, b0);
+			growBounds(bmin, bmax, b1);
+			growBounds(cmin, cmax, c0);
+			growBounds(cmin, cmax, c1);
+			});
+	}
+	else
+		objectBounds(&build[first], count, bmin, bmax, cmin, cmax);
+
+	tree[node].min = bmin;
+	tree[node].max = bmax;
+	tree[node].index = first;
+	tree[node].count = count;
+
+	if (count <= 1 || depth >= BVH_MAX_DEPTH - 1) return;
+
+	int axis, bin;
+	int mid;
+	bool found = FindSplit(build, first, count, cmin, cmax, surfaceArea(bmin, bmax), subtrees != NULL, axis, bin);
+
+	if (found) {
+		float extent = axisOf(cmax, axis) - axisOf(cmin, axis);
+		float lo = axisOf(cmin, axis);
+		BuildObject* middle = partition(&build[first], &build[first] + count, [&](const BuildObject& b) {
+			int i = (int)((axisOf(b.centroid, axis) - lo) * BVH_BINS / extent);
+			return MIN(i, BVH_BINS - 1) <= bin;
+			});
+		mid = middle - &build[0];
+	}
+	else {
+		if (count <= BVH_MAX_LEAF) return;   // splitting would not pay off
+
+		// every centroid falls in the same bin: split at the object median of the widest axis
+		Vector extent = cmax - cmin;
+		axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+		mid = first + count / 2;
+		nth_element(&build[first], &build[mid], &build[first] + count, [&](const BuildObject& a, const BuildObject& b) {
+			return axisOf(a.centroid, axis) < axisOf(b.centroid, axis);
+			});
+	}
+
+	if (mid == first || mid == first + count)
+		mid = first + count / 2;
+
+	int left = tree.size();
+	tree.push_back(BVHNode());
+	tree.push_back(BVHNode());
+	tree[node].index = left;
+	tree[node].count = 0;
+
+	Subdivide(build, tree, left, first, mid - first, depth + 1, subtrees);
+	Subdivide(build, tree, left + 1, mid, first + count - mid, depth + 1, subtrees);
+}
+
+// Objects per bin along the three axes, and the bounds of their boxes
+struct Bins {
+	int count[3][BVH_BINS];
+	Vector min[3][BVH_BINS], max[3][BVH_BINS];
+
+	Bins()
+	{
+		for (int a = 0; a < 3; a++)
+			for (int b = 0; b < BVH_BINS; b++) {   // without a Vector temporary per bin
+				count[a][b] = 0;
+				min[a][b].x = min[a][b].y = min[a][b].z = FLT_MAX;
+				max[a][b].x = max[a][b].y = max[a][b].z = -FLT_MAX;
+			}
+	}
+
+	void add(const BVH::BuildObject* b, int n, const Vector& cmin, const Vector& cmax)
+	{
+		for (int a = 0; a < 3; a++) {
+			float lo = axisOf(cmin, a);
+			float extent = axisOf(cmax, a) - lo;
+			if (extent <= 0.0f) continue;
+
+			for (int i = 0; i < n; i++) {
+				int k = MIN((int)((axisOf(b[i].centroid, a) - lo) * BVH_BINS / extent), BVH_BINS - 1);
+				count[a][k]++;
+				growBounds(min[a][k], max[a][k], b[i].min);
+				growBounds(min[a][k], max[a][k], b[i].max);
+			}
+		}
+	}
+
+	void merge(const Bins& other)
+	{
+		for (int a = 0; a < 3; a++)
+			for (int k = 0; k < BVH_BINS; k++)
+				if (other.count[a][k]) {
+					count[a][k] += other.count[a][k];
+					growBounds(min[a][k], max[a][k], other.min[a][k]);
+					growBounds(min[a][k], max[a][k], other.max[a][k]);
+				}
+	}
+};
+
+// Bins the centroids along every axis and sweeps the bin boundaries for the cheapest split:
+// cost = 1 + (area_left * n_left + area_right * n_right) / area_node, against count for a leaf.
+// Returns false when no split beats the leaf cost.
+
+bool BVH::FindSplit(vector<BuildObject>& build, int first, int count, const Vector& cmin, const Vector& cmax, float nodeArea, bool parallel, int& axis, int& bin)
+{
+	float bestCost = FLT_MAX;
+
+	Bins bins;
+	if (parallel) {
+		mutex lock;
+		parallelFor(count, [&](int begin, int end) {
+			Bins part;
+			part.add(&build[first + begin], end - begin, cmin, cmax);
+
+			lock_guard<mutex> guard(lock);
+			bins.merge(part);
+			});
+	}
+	else
+		bins.add(&build[first], count, cmin, cmax);
+
+	for (int a = 0; a < 3; a++) {
+		if (axisOf(cmax, a) - axisOf(cmin, a) <= 0.0f) continue;
+
+		const int* binCount = bins.count[a];
+		const Vector* binMin = bins.min[a];
+		const Vector* binMax = bins.max[a];
+
+		// leftCost[b]: area * count of everything in bins 0..b
+		float leftCost[BVH_BINS];
+		Vector lmin = Vector(FLT_MAX, FLT_MAX, FLT_MAX), lmax = Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		int n = 0;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			n += binCount[b];
+			if (binCount[b]) {
+				growBounds(lmin, lmax, binMin[b]);
+				growBounds(lmin, lmax, binMax[b]);
+			}
+			leftCost[b] = n * surfaceArea(lmin, lmax);
+		}
+
+		Vector rmin = Vector(FLT_MAX, FLT_MAX, FLT_MAX), rmax = Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		n = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			n += binCount[b];
+			if (binCount[b]) {
+				growBounds(rmin, rmax, binMin[b]);
+				growBounds(rmin, rmax, binMax[b]);
+			}
+			if (n == 0 || n == count) continue;
+
+			float cost = leftCost[b - 1] + n * surfaceArea(rmin, rmax);
+			if (cost < bestCost) {
+				bestCost = cost;
+				axis = a;
+				bin = b - 1;
+			}
+		}
+	}
+
+	if (bestCost == FLT_MAX) return false;
+
+	float splitCost = 1.0f + bestCost / nodeArea;
+	return splitCost < count || count > BVH_MAX_LEAF;
+}
+
+inline bool BVH::IntersectNode(const BVHNode& node, const Vector& origin, const Vector& invDir, float tmax, float& tEntry)
+{
+	float tx0 = (node.min.x - origin.x) * invDir.x, tx1 = (node.max.x - origin.x) * invDir.x;
+	float ty0 = (node.min.y - origin.y) * invDir.y, ty1 = (node.max.y - origin.y) * invDir.y;
+	float tz0 = (node.min.z - origin.z) * invDir.z, tz1 = (node.max.z - origin.z) * invDir.z;
+
+	float t0 = maxf(maxf(minf(tx0, tx1), minf(ty0, ty1)), minf(tz0, tz1));
+	float t1 = minf(minf(maxf(tx0, tx1), maxf(ty0, ty1)), maxf(tz0, tz1));
+
+	tEntry = t0;
+	return t0 <= t1 && t1 >= 0.0f && t0 < tmax;
+}
+
+bool BVH::TraverseFrom(int root, Ray& ray, const Vector& invDir, float& tBest, PrimRef& hit)
+{
+	int stack[BVH_MAX_DEPTH];
+	float stackT[BVH_MAX_DEPTH];
+	int sp = 0;
+
+	bool hitObject = false;
+	float t;
+
+	if (!IntersectNode(nodes[root], ray.origin, invDir, tBest, t)) return false;
+	stack[sp] = root; stackT[sp++] = t;
+
+	while (sp > 0) {
+		sp--;
+		if (stackT[sp] > tBest) continue;   // a closer hit was found after this node was pushed
+		const BVHNode& node = nodes[stack[sp]];
+
+		if (node.count > 0) {
+			RayStats::local().objectTests += node.count;
+			if (scene->Intersect(&objects[node.index], node.count, ray, tBest, hit))
+				hitObject = true;
+			continue;
+		}
+
+		// visit the nearest child first
+		float tLeft, tRight;
+		bool hitLeft = IntersectNode(nodes[node.index], ray.origin, invDir, tBest, tLeft);
+		bool hitRight = IntersectNode(nodes[node.index + 1], ray.origin, invDir, tBest, tRight);
+
+		if (hitLeft && hitRight) {
+			if (tLeft <= tRight) {
+				stack[sp] = node.index + 1; stackT[sp++] = tRight;
+				stack[sp] = node.index; stackT[sp++] = tLeft;
+			}
+			else {
+				stack[sp] = node.index; stackT[sp++] = tLeft;
+				stack[sp] = node.index + 1; stackT[sp++] = tRight;
+			}
+		}
+		else if (hitLeft) {
+			stack[sp] = node.index; stackT[sp++] = tLeft;
+		}
+		else if (hitRight) {
+			stack[sp] = node.index + 1; stackT[sp++] = tRight;
+		}
+	}
+	return hitObject;
+}
+
+bool BVH::Traverse(Ray& ray, HitRecord& hit)
+{
+	hit.t = INFINITY;
+	bool found = IntersectUnbounded(ray, hit.t, hit.prim);
+
+	if (!nodes.empty()) {
+		Vector invDir = Vector(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+		if (TraverseFrom(0, ray, invDir, hit.t, hit.prim)) found = true;
+	}
+	if (!found) return false;
+	scene->CompleteHit(ray, hit);
+	return true;
+}
+
+// The nodes entered beyond tmax are culled like those the ray misses
+bool BVH::OccludedFrom(int root, Ray& ray, const Vector& invDir, float tmax)
+{
+	RayStats& stats = RayStats::local();
+	int stack[BVH_MAX_DEPTH];
+	int sp = 0;
+	float t;
+
+	stack[sp++] = root;
+
+	while (sp > 0) {
+		const BVHNode& node = nodes[stack[--sp]];
+
+		if (!IntersectNode(node, ray.origin, invDir, tmax, t)) continue;
+		stats.shadowCells++;
+
+		if (node.count > 0) {
+			stats.objectTests += node.count;
+			stats.shadowTests += node.count;
+			if (scene->Occluded(&objects[node.index], node.count, ray, tmax)) return true;
+			continue;
+		}
+
+		stack[sp++] = node.index + 1;
+		stack[sp++] = node.index;
+	}
+	return false;
+}
+
+bool BVH::Occluded(Ray& ray, float tmax)
+{
+	if (OccludedUnbounded(ray, tmax)) return true;
+	if (nodes.empty()) return false;
+
+	Vector invDir = Vector(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+	return OccludedFrom(0, ray, invDir, tmax);
+}
+
+// The packet goes down the tree with the mask of its rays that hit each node: a node is visited
+// when any of them does, the children are tested against those rays only, and a leaf intersects
+// its objects with each of them. Once the mask is down to one ray, the packet has diverged and
+// that ray finishes the subtree on its own.
+void BVH::TraversePacket(Ray* rays, int count, HitRecord* hits, bool* hitObject)
+{
+	PacketRays p(rays, count);
+	float tBest[PACKET_SIZE], tEntry[PACKET_SIZE];
+	int stack[BVH_MAX_DEPTH];
+	uint32_t stackMask[BVH_MAX_DEPTH];
+	int sp = 0;
+
+	for (int i = 0; i < PACKET_SIZE; i++) tBest[i] = INFINITY;
+	for (int i = 0; i < count; i++)
+		hitObject[i] = IntersectUnbounded(rays[i], tBest[i], hits[i].prim);
+
+	uint32_t mask = nodes.empty() ? 0 : boxPacket(nodes[0].min, nodes[0].max, p, tBest, tEntry);
+	if (mask) { stack[sp] = 0; stackMask[sp++] = mask; }
+
+	while (sp > 0) {
+		sp--;
+		int index = stack[sp];
+		const BVHNode& node = nodes[index];
+		mask = stackMask[sp];
+
+		if ((mask & (mask - 1)) == 0) {
+			int i = firstLane(mask);
+			Vector invDir = Vector(p.ix[i], p.iy[i], p.iz[i]);
+			if (TraverseFrom(index, rays[i], invDir, tBest[i], hits[i].prim)) hitObject[i] = true;
+			continue;
+		}
+
+		if (node.count > 0) {
+			mask &= boxPacket(node.min, node.max, p, tBest, tEntry);   // drop the rays with a closer hit by now
+			for (int i = 0; i < count; i++) {
+				if (!(mask & (1u << i))) continue;
+				RayStats::local().objectTests += node.count;
+				if (scene->Intersect(&objects[node.index], node.count, rays[i], tBest[i], hits[i].prim))
+					hitObject[i] = true;
+			}
+			continue;
+		}
+
+		float tLeft[PACKET_SIZE], tRight[PACKET_SIZE];
+		uint32_t maskLeft = boxPacket(nodes[node.index].min, nodes[node.index].max, p, tBest, tLeft) & mask;
+		uint32_t maskRight = boxPacket(nodes[node.index + 1].min, nodes[node.index + 1].max, p, tBest, tRight) & mask;
+
+		// visit first the child the first ray that hits both enters first
+		bool leftFirst = true;
+		if (maskLeft & maskRight) {
+			int i = firstLane(maskLeft & maskRight);
+			leftFirst = tLeft[i] <= tRight[i];
+		}
+		if (leftFirst) {
+			if (maskRight) { stack[sp] = node.index + 1; stackMask[sp++] = maskRight; }
+			if (maskLeft) { stack[sp] = node.index; stackMask[sp++] = maskLeft; }
+		}
+		else {
+			if (maskLeft) { stack[sp] = node.index; stackMask[sp++] = maskLeft; }
+			if (maskRight) { stack[sp] = node.index + 1; stackMask[sp++] = maskRight; }
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!hitObject[i]) continue;
+		hits[i].t = tBest[i];
+		scene->CompleteHit(rays[i], hits[i]);
+	}
+}
+
+void BVH::OccludedPacket(Ray* rays, const float* maxDist, int count, bool* occluded)
+{
+	RayStats& stats = RayStats::local();
+	PacketRays p(rays, count);
+	float tmax[PACKET_SIZE], tEntry[PACKET_SIZE];
+	int stack[BVH_MAX_DEPTH];
+	uint32_t stackMask[BVH_MAX_DEPTH];
+	int sp = 0;
+
+	for (int i = 0; i < PACKET_SIZE; i++) tmax[i] = i < count ? maxDist[i] : 0.0f;
+
+	uint32_t done = 0;   // rays found to be occluded
+	for (int i = 0; i < count; i++)
+		if (OccludedUnbounded(rays[i], tmax[i])) done |= 1u << i;
+	if (!nodes.empty()) { stack[sp] = 0; stackMask[sp++] = (1u << count) - 1u; }
+
+	while (sp > 0) {
+		sp--;
+		int index = stack[sp];
+		const BVHNode& node = nodes[index];
+		uint32_t mask = stackMask[sp] & ~done;
+
+		if (mask == 0) continue;
+		if ((mask & (mask - 1)) == 0) {
+			int i = firstLane(mask);
+			if (OccludedFrom(index, rays[i], Vector(p.ix[i], p.iy[i], p.iz[i]), tmax[i])) done |= mask;
+			continue;
+		}
+
+		mask &= boxPacket(node.min, node.max, p, tmax, tEntry);
+		if (mask == 0) continue;
+		stats.shadowCells += countLanes(mask);
+
+		if (node.count > 0) {
+			for (int i = 0; i < count; i++) {
+				if (!(mask & (1u << i))) continue;
+				stats.objectTests += node.count;
+				stats.shadowTests += node.count;
+				if (scene->Occluded(&objects[node.index], node.count, rays[i], tmax[i])) done |= 1u << i;
+			}
+			continue;
+		}
+
+		stack[sp] = node.index + 1; stackMask[sp++] = mask;
+		stack[sp] = node.index; stackMask[sp++] = mask;
+	}
+
+	for (int i = 0; i < count; i++)
+		occluded[i] = (done & (1u << i)) != 0;
+}
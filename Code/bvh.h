@@ -0,0 +1,66 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <cmath>
+#include "scene.h"
+#include "accelerator.h"
+
+using namespace std;
+
+#define BVH_BINS 16      // number of bins per axis used to evaluate the SAH
+#define BVH_MAX_LEAF 4   // nodes with more objects than this are always split
+
+// Bounding volume hierarchy built top-down with the binned surface area heuristic
+
+class BVH : public Accelerator
+{
+public:
+	BVH(Scene* scene, ThreadPool* pool = NULL);
+
+	int getNumObjects();
+	const PrimRef& getObject(unsigned int index);
+
+	int getNumNodes();
+
+	void Build();   // set up the hierarchy
+
+	bool Traverse(Ray& ray, HitRecord& hit);
+	bool Occluded(Ray& ray, float tmax);
+
+	void TraversePacket(Ray* rays, int count, HitRecord* hits, bool* hit);
+	void OccludedPacket(Ray* rays, const float* tmax, int count, bool* occluded);
+
+	struct BuildObject {
+		Vector min, max, centroid;
+		PrimRef object;
+	};
+
+protected:
+	uint32_t fileTag();
+	void SaveData(AccelWriter& out);
+	bool LoadData(AccelReader& in);
+
+private:
+	struct BVHNode {
+		Vector min, max;
+		int index;   // leaf: first object; interior: left child (right child is index + 1)
+		int count;   // number of objects, 0 for interior nodes
+	};
+
+	struct Subtree {   // left by the top of the build to one task
+		int node, first, count, depth;
+	};
+
+	vector<PrimRef> objects;   // the bounded primitives, sorted so that every leaf holds a contiguous range
+	vector<BVHNode> nodes;
+
+	void Subdivide(vector<BuildObject>& build, vector<BVHNode>& tree, int node, int first, int count, int depth, vector<Subtree>* subtrees);
+	bool FindSplit(vector<BuildObject>& build, int first, int count, const Vector& cmin, const Vector& cmax, float nodeArea, bool parallel, int& axis, int& bin);
+	bool IntersectNode(const BVHNode& node, const Vector& origin, const Vector& invDir, float tmax, float& tEntry);
+
+	// single ray traversals of the subtree of root, also used by the packets that are left with one ray
+	bool TraverseFrom(int root, Ray& ray, const Vector& invDir, float& tBest, PrimRef& hit);
+	bool OccludedFrom(int root, Ray& ray, const Vector& invDir, float tmax);
+};
+#endif
@@ -1,302 +1,1057 @@
-#include <iostream>
-#include <string>
-#include <fstream>
-#include <IL/il.h>
-
-#include "grid.h"
-#include "scene.h"
-#include "maths.h"
-
-Grid::Grid(vector<Object*> sceneObjects)
-{
-	for (int j = 0; j < sceneObjects.size(); j++)
-		addObject(sceneObjects[j]);
-
-	Build();
-}
-
-int Grid::getNumObjects()
-{
-	return objects.size();
-}
-
-void Grid::addObject(Object* o)
-{
-	objects.push_back(o);
-}
-
-Object* Grid::getObject(unsigned int index)
-{
-	if (index >= 0 && index < objects.size())
-		return objects[index];
-	return NULL;
-}
-
-int Grid::getNumCells()
-{
-	return cells.size();
-}
-
-Vector Grid::find_min_bounds()
-{
-	AABB box;
-	Vector p0 = Vector(numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max());
-
-	int num_objects = getNumObjects();
-	
-	for (int j = 0; j < num_objects; j++) {
-		Object* object = getObject(j);
-		box = object->GetBoundingBox();
-
-		if (box.min.x < p0.x)
-			p0.x = box.min.x;
-		if (box.min.y < p0.y)
-			p0.y = box.min.y;
-		if (box.min.z < p0.z)
-			p0.z = box.min.z;
-	}
-	p0.x -= EPSILON; p0.y -= EPSILON; p0.z -= EPSILON;
-
-	return (p0);
-}
-
-Vector Grid::find_max_bounds()
-{
-	AABB box;
-	Vector p1 = Vector(numeric_limits<float>::min(), numeric_limits<float>::min(), numeric_limits<float>::min());
-
-	for (int j = 0; j < getNumObjects(); j++) {
-		Object* object = getObject(j);
-		box = object->GetBoundingBox();
-
-		if (box.max.x > p1.x)
-			p1.x = box.max.x;
-		if (box.max.y > p1.y)
-			p1.y = box.max.y;
-		if (box.max.z > p1.z)
-			p1.z = box.max.z;
-	}
-	p1.x += EPSILON; p1.y += EPSILON; p1.z += EPSILON;
-
-	return (p1);
-}
-
-void Grid::Build()
-{	
-	bbox.max = find_max_bounds();
-	bbox.min = find_min_bounds();
-	Vector dim = bbox.max - bbox.min;
-
-	float S = pow(getNumObjects() / (dim.x * dim.y * dim.z), 1.0f/3.0f);
-
-	nx = trunc(m * dim.x * S) + 1;
-	ny = trunc(m * dim.y * S) + 1;
-	nz = trunc(m * dim.z * S) + 1;
-
-	int totalcells = nx * ny * nz;
-	for (int i = 0; i < totalcells; i++) {
-		vector<Object*> cell;
-		cells.push_back(cell);
-	}
-
-	for (int i = 0; i < getNumObjects(); i++) {
-		Vector objBBmin = getObject(i)->GetBoundingBox().min;
-		Vector objBBmax = getObject(i)->GetBoundingBox().max;
-
-		int ixmin = clamp((int)((objBBmin.x - bbox.min.x) * nx / dim.x), 0, int(nx - 1));
-		int iymin = clamp((int)((objBBmin.y - bbox.min.y) * ny / dim.y), 0, int(ny - 1));
-		int izmin = clamp((int)((objBBmin.z - bbox.min.z) * nz / dim.z), 0, int(nz - 1));
-
-		int ixmax = clamp((int)((objBBmax.x - bbox.min.x) * nx / dim.x), 0, int(nx - 1));
-		int iymax = clamp((int)((objBBmax.y - bbox.min.y) * ny / dim.y), 0, int(ny - 1));
-		int izmax = clamp((int)((objBBmax.z - bbox.min.z) * nz / dim.z), 0, int(nz - 1));
-
-		for (int iz = izmin; iz <= izmax; iz++) {
-			for (int iy = iymin; iy <= iymax; iy++) {
-				for (int ix = ixmin; ix <= ixmax; ix++) {
-					int index = ix + nx * iy + nx * ny * iz;
-					cells[index].push_back(getObject(i));
-				}
-			}
-		}
-	}
-}
-
-void Grid::Init_Traverse(float dx, float& index, double& dtx, float& t_next, float& i_step, float& i_stop, float& tmin, float& tmax, int nx) {
-	if (dx > 0) {
-		t_next = tmin + (index + 1) * dtx;
-		i_step = +1;
-		i_stop = nx;
-	}
-	else {
-		t_next = tmin + (nx - index) * dtx;
-		i_step = -1;
-		i_stop = -1;
-	}
-
-	if (dx == 0.0) {
-		t_next = numeric_limits<float>::max();
-		i_step = -1;
-		i_stop = -1;
-	}
-}
-
-Object* Grid::Traverse(Ray& ray, float& tNear)
-{
-	float ox = ray.origin.x; float oy = ray.origin.y; float oz = ray.origin.z;
-	float dx = ray.direction.x; float dy = ray.direction.y; float dz = ray.direction.z;
-
-	Vector tmin;
-	Vector tmax;
-
-	float t0 = numeric_limits<float>::min();
-	float t1 = numeric_limits<float>::max();
-
-	if (!bbox.intercepts(ray, t0, t1, tmin, tmax)) return nullptr;
-	
-	Vector index; //starting cell indices
-
-	// checks if ray starts inside the grid
-	if (bbox.isInside(ray.origin)) {
-		index.x = clamp((int)((ox - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
-		index.y = clamp((int)((oy - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
-		index.z = clamp((int)((oz - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
-	}
-	else {
-		// initial hit point with grid's bounding box
-		Vector p = ray.origin + ray.direction * t0;
-		index.x = clamp((int)((p.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
-		index.y = clamp((int)((p.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
-		index.z = clamp((int)((p.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
-	}
-
-	// ray parameter increments per cell in the x, y, and z directions
-	double dtx = (tmax.x - tmin.x) / nx;
-	double dty = (tmax.y - tmin.y) / ny;
-	double dtz = (tmax.z - tmin.z) / nz;
-
-	Vector t_next, i_step, i_stop;
-
-	Init_Traverse(dx, index.x, dtx, t_next.x, i_step.x, i_stop.x, tmin.x, tmax.x, nx);
-	Init_Traverse(dy, index.y, dty, t_next.y, i_step.y, i_stop.y, tmin.y, tmax.y, ny);
-	Init_Traverse(dz, index.z, dtz, t_next.z, i_step.z, i_stop.z, tmin.z, tmax.z, nz);
-
-	// Traverse the grid
-	while (true) {
-		int cellIndex = index.x + nx * index.y + nx * ny * index.z;
-		vector<Object*> cell = cells[cellIndex];
-		Object* hitobject = nullptr;
-		float tNearaux = INFINITY;
-		float taux;
-
-		// checks intercection with objects
-		for (int i = 0; i < cell.size(); i++) {
-			if (cell[i]->intercepts(ray, taux) && taux < tNearaux) {
-				tNearaux = taux;
-				hitobject = cell[i];
-				tNear = tNearaux;
-			}
-		}
-		
-		if (t_next.x < t_next.y && t_next.x < t_next.z) {
-			if (hitobject && tNearaux < t_next.x) return hitobject;
-			t_next.x += dtx;
-			index.x += i_step.x;
-
-			if (index.x == i_stop.x)
-				return nullptr;
-		}
-		else {
-			if (t_next.y < t_next.z) {
-				if (hitobject && tNearaux < t_next.y) return hitobject;
-				t_next.y += dty;
-				index.y += i_step.y;
-
-				if (index.y == i_stop.y)
-					return nullptr;
-			}
-			else {
-				if (hitobject && tNearaux < t_next.z) return hitobject;
-				t_next.z += dtz;
-				index.z += i_step.z;
-
-				if (index.z == i_stop.z)
-					return nullptr;
-			}
-		}
-	}
-}
-
-bool Grid::TraverseShadow(Ray& ray) {
-	float ox = ray.origin.x; float oy = ray.origin.y; float oz = ray.origin.z;
-	float dx = ray.direction.x; float dy = ray.direction.y; float dz = ray.direction.z;
-
-	Vector tmin;
-	Vector tmax;
-
-	float t0 = numeric_limits<float>::min();
-	float t1 = numeric_limits<float>::max();
-
-	if (!bbox.intercepts(ray, t0, t1, tmin, tmax)) return false;
-
-	Vector index; //starting cell indices
-
-	if (bbox.isInside(ray.origin)) {  			// does the ray start inside the grid?
-		index.x = clamp((int)((ox - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
-		index.y = clamp((int)((oy - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
-		index.z = clamp((int)((oz - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
-	}
-	else {
-		Vector p = ray.origin + ray.direction * t0;  // initial hit point with grid's bounding box
-		index.x = clamp((int)((p.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
-		index.y = clamp((int)((p.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
-		index.z = clamp((int)((p.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
-	}
-
-	// ray parameter increments per cell in the x, y, and z directions
-
-	double dtx = (tmax.x - tmin.x) / nx;
-	double dty = (tmax.y - tmin.y) / ny;
-	double dtz = (tmax.z - tmin.z) / nz;
-
-	Vector t_next, i_step, i_stop;
-
-	Init_Traverse(dx, index.x, dtx, t_next.x, i_step.x, i_stop.x, tmin.x, tmax.x, nx);
-	Init_Traverse(dy, index.y, dty, t_next.y, i_step.y, i_stop.y, tmin.y, tmax.y, ny);
-	Init_Traverse(dz, index.z, dtz, t_next.z, i_step.z, i_stop.z, tmin.z, tmax.z, nz);
-	
-	while (true) {
-		int cellIndex = index.x + nx * index.y + nx * ny * index.z;
-		vector<Object*> cell = cells[cellIndex];
-		Object* hitobject = nullptr;
-		float taux;
-
-		for (int i = 0; i < cell.size(); i++)
-			if (cell[i]->intercepts(ray, taux)) return true;
-
-		if (t_next.x < t_next.y && t_next.x < t_next.z) {
-			t_next.x += dtx;
-			index.x += i_step.x;
-
-			if (index.x == i_stop.x)
-				return false;
-		}
-		else {
-			if (t_next.y < t_next.z) {
-				t_next.y += dty;
-				index.y += i_step.y;
-
-				if (index.y == i_stop.y)
-					return false;
-			}
-			else {
-				t_next.z += dtz;
-				index.z += i_step.z;
-
-				if (index.z == i_stop.z)
-					return false;
-			}
-		}
-	}
-}
-
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#include "grid.h"
+#include "scene.h"
+#include "maths.h"
+#include "stats.h"
+
+#define GRID_BATCH 64   // references of a cell intersected per call to the scene
+
+// Automatic resolution (see ChooseFactor()): costs in units of one ray/object test
+#define GRID_PROBES 32                   // the probe rays are a GRID_PROBES x GRID_PROBES lattice of pixels
+#define GRID_COST_STEP 5.0f              // visiting a cell, or jumping from it across empty ones
+#define GRID_COST_TEST 1.0f
+#define GRID_MAX_CELLS_PER_OBJECT 64     // memory bound of the candidate resolutions
+
+// Two-level grid: cells of the top grid holding more than GRID_DENSE_CELL objects get a sub-grid,
+// sized for their objects with the factor GRID_SUB_M
+#define GRID_DENSE_CELL 16
+#define GRID_SUB_M 2.0f
+
+#define GRID_MAX_DIST 255   // cap of the distances to the nearest non-empty cell
+
+// Ray mailbox: objects that span several cells are stored in each of them, so a ray
+// would test them again in every cell it visits. Each thread stamps the objects it
+// tests with the id of its current ray and skips the ones already stamped.
+struct Mailbox {
+	vector<uint32_t> stamp;  // id of the last ray tested against each object
+	uint32_t rayId = 0;
+};
+
+static thread_local Mailbox mailbox;
+
+static Mailbox& NewMailboxRay(int num_objects)
+{
+	if (mailbox.stamp.size() < (size_t)num_objects)
+		mailbox.stamp.resize(num_objects, 0);
+
+	if (++mailbox.rayId == 0) { // ids wrapped around: forget the old stamps
+		fill(mailbox.stamp.begin(), mailbox.stamp.end(), 0);
+		mailbox.rayId = 1;
+	}
+	return mailbox;
+}
+
+Grid::Grid(Scene* a_Scene, ThreadPool* a_Pool, float a_m, int a_levels) : Accelerator(a_Scene, a_Pool), m(a_m), levels(a_levels)
+{
+	SplitPrimitives(objects);
+}
+
+int Grid::getNumObjects()
+{
+	return objects.size();
+}
+
+const PrimRef& Grid::getObject(unsigned int index)
+{
+	return objects[index];
+}
+
+int Grid::getNumCells()
+{
+	int cells = top.nx * top.ny * top.nz;
+	for (size_t i = 0; i < sub.size(); i++)
+		cells += sub[i].nx * sub[i].ny * sub[i].nz;
+	return cells;
+}
+
+size_t Grid::getMemoryUsage()
+{
+	size_t bytes = (top.cellStart.size() + top.cellObjects.size()) * sizeof(uint32_t) + top.cellChild.size() * sizeof(int) + top.cellDist.size();
+	for (size_t i = 0; i < sub.size(); i++)
+		bytes += (sub[i].cellStart.size() + sub[i].cellObjects.size()) * sizeof(uint32_t) + sub[i].cellDist.size();
+	return bytes;
+}
+
+Vector Grid::find_min_bounds()
+{
+	AABB box;
+	Vector p0 = Vector(numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max());
+
+	int num_objects = getNumObjects();
+	
+	for (int j = 0; j < num_objects; j++) {
+		box = boxes[j];
+
+		if (box.min.x < p0.x)
+			p0.x = box.min.x;
+		if (box.min.y < p0.y)
+			p0.y = box.min.y;
+		if (box.min.z < p0.z)
+			p0.z = box.min.z;
+	}
+	p0.x -= EPSILON; p0.y -= EPSILON; p0.z -= EPSILON;
+
+	return (p0);
+}
+
+Vector Grid::find_max_bounds()
+{
+	AABB box;
+	Vector p1 = Vector(numeric_limits<float>::min(), numeric_limits<float>::min(), numeric_limits<float>::min());
+
+	for (int j = 0; j < getNumObjects(); j++) {
+		box = boxes[j];
+
+		if (box.max.x > p1.x)
+			p1.x = box.max.x;
+		if (box.max.y > p1.y)
+			p1.y = box.max.y;
+		if (box.max.z > p1.z)
+			p1.z = box.max.z;
+	}
+	p1.x += EPSILON; p1.y += EPSILON; p1.z += EPSILON;
+
+	return (p1);
+}
+
+void Grid::Build()
+{	
+	top = GridLevel();
+	sub.clear();
+	if (objects.empty()) {   // nothing but planes
+		top.nx = top.ny = top.nz = 0;
+		PrintLevels();
+		return;
+	}
+
+	boxes.resize(objects.size());
+	parallelFor(objects.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++) boxes[i] = scene->GetBoundingBox(objects[i]);
+		});
+
+	top.bbox.max = find_max_bounds();
+	top.bbox.min = find_min_bounds();
+
+	BuildLevels(m > 0.0f ? m : ChooseFactor());
+	PrintLevels();
+}
+
+void Grid::PrintLevels()
+{
+	if (objects.empty()) {
+		printf("Grid: no bounded objects, %d unbounded\n", (int)unbounded.size());
+		return;
+	}
+	printf("Grid %d x %d x %d: %d cells, %d object references, %.1f KB, %d unbounded objects\n",
+		top.nx, top.ny, top.nz, top.nx * top.ny * top.nz, (int)top.cellObjects.size(), getMemoryUsage() / 1024.0, (int)unbounded.size());
+	if (levels > 1) {
+		size_t references = 0;
+		for (size_t i = 0; i < sub.size(); i++) references += sub[i].cellObjects.size();
+		printf("Grid second level: %d sub-grids, %d cells, %d object references\n",
+			(int)sub.size(), getNumCells() - top.nx * top.ny * top.nz, (int)references);
+	}
+}
+
+uint32_t Grid::fileTag()
+{
+	return levels > 1 ? 0x32445247 : 0x31445247;   // "GRD2", "GRD1"
+}
+
+static void saveLevel(AccelWriter& out, const Grid::GridLevel& level)
+{
+	out.write(level.bbox.min);
+	out.write(level.bbox.max);
+	out.write(level.nx);
+	out.write(level.ny);
+	out.write(level.nz);
+	out.writeArray(level.cellStart);
+	out.writeArray(level.cellObjects);
+	out.writeArray(level.cellChild);
+	out.writeArray(level.cellDist);
+}
+
+// Reads a level written by saveLevel() and checks that its arrays fit together: the cell ranges
+// in order inside cellObjects, cellChild only on the top level, and a finite box
+static bool loadLevel(AccelReader& in, Grid::GridLevel& level, size_t numObjects, bool isTop)
+{
+	in.read(level.bbox.min);
+	in.read(level.bbox.max);
+	in.read(level.nx);
+	in.read(level.ny);
+	in.read(level.nz);
+	in.readArray(level.cellStart);
+	in.readArray(level.cellObjects);
+	in.readArray(level.cellChild);
+	in.readArray(level.cellDist);
+	if (!in.ok || level.nx < 0 || level.ny < 0 || level.nz < 0) return false;
+	const Vector& lo = level.bbox.min;
+	const Vector& hi = level.bbox.max;
+	if (!(isfinite(lo.x) && isfinite(lo.y) && isfinite(lo.z) && isfinite(hi.x) && isfinite(hi.y) && isfinite(hi.z) &&
+		lo.x <= hi.x && lo.y <= hi.y && lo.z <= hi.z))
+		return false;
+
+	size_t cells = (size_t)level.nx * level.ny * level.nz;
+	if (cells == 0)   // the grid of a scene with nothing but planes
+		return level.cellStart.empty() && level.cellObjects.empty() && level.cellChild.empty() && level.cellDist.empty();
+	if (level.cellStart.size() != cells + 1 || level.cellDist.size() != cells || level.cellStart[0] != 0 ||
+		level.cellStart[cells] != level.cellObjects.size() || (!level.cellChild.empty() && (!isTop || level.cellChild.size() != cells)))
+		return false;
+	for (size_t c = 0; c < cells; c++)
+		if (level.cellStart[c] > level.cellStart[c + 1]) return false;
+	for (size_t i = 0; i < level.cellObjects.size(); i++)
+		if (level.cellObjects[i] >= numObjects) return false;
+	return true;
+}
+
+// The requested m is saved with the cells: a file written for another --grid-m is not used
+void Grid::SaveData(AccelWriter& out)
+{
+	out.write(m);
+	saveLevel(out, top);
+	out.write((uint64_t)sub.size());
+	for (size_t i = 0; i < sub.size(); i++)
+		saveLevel(out, sub[i]);
+}
+
+bool Grid::LoadData(AccelReader& in)
+{
+	float savedM = 0.0f;
+	uint64_t numSub = 0;
+	GridLevel t;
+
+	in.read(savedM);
+	if (!in.ok || savedM != m || !loadLevel(in, t, objects.size(), true)) return false;
+	in.read(numSub);
+	if (!in.ok || numSub > t.cellStart.size()) return false;
+
+	vector<GridLevel> s(numSub);
+	for (size_t i = 0; i < s.size(); i++)
+		if (!loadLevel(in, s[i], objects.size(), false)) return false;
+	for (size_t i = 0; i < t.cellChild.size(); i++)
+		if (t.cellChild[i] < -1 || t.cellChild[i] >= (int)s.size()) return false;
+
+	top = move(t);
+	sub.swap(s);
+	PrintLevels();
+	return true;
+}
+
+// The grid is built with the factors from 0.5 to 8, a factor of sqrt(2) apart, and a lattice of
+// GRID_PROBES x GRID_PROBES camera rays is traced through each one: the cost of a factor is the
+// cells those rays visit and the objects they test, weighted by GRID_COST_STEP and
+// GRID_COST_TEST. The cheapest one wins.
+float Grid::ChooseFactor()
+{
+	Camera* camera = scene->GetCamera();
+	if (camera == NULL) return 2.0f;
+
+	vector<Ray> probes;
+	for (int y = 0; y < GRID_PROBES; y++)
+		for (int x = 0; x < GRID_PROBES; x++) {
+			Vector pixel = Vector((x + 0.5f) * camera->GetResX() / GRID_PROBES, (y + 0.5f) * camera->GetResY() / GRID_PROBES, 0.0f);
+			probes.push_back(camera->PrimaryRay(pixel));
+		}
+
+	RayStats& stats = RayStats::local();
+	float best = 2.0f, bestCost = INFINITY, fixedCost = NAN;
+
+	for (int i = 0; i < 9; i++) {
+		float factor = 0.5f * pow(2.0f, i * 0.5f);
+		SetResolution(top, factor, getNumObjects());
+		if ((double)top.nx * top.ny * top.nz > GRID_MAX_CELLS_PER_OBJECT * (double)getNumObjects()) break;
+		BuildLevels(factor);
+
+		uint64_t cells = stats.cells, tests = stats.objectTests;
+		for (size_t n = 0; n < probes.size(); n++) {
+			float t = INFINITY;
+			PrimRef hit;
+			FindHit(probes[n], t, hit);
+		}
+		float cost = (GRID_COST_STEP * (stats.cells - cells) + GRID_COST_TEST * (stats.objectTests - tests)) / probes.size();
+
+		if (factor == 2.0f) fixedCost = cost;
+		if (cost < bestCost) {
+			bestCost = cost;
+			best = factor;
+		}
+	}
+	if (bestCost == INFINITY) return best;  // no factor fits under GRID_MAX_CELLS_PER_OBJECT
+	if (isnan(fixedCost))
+		printf("Grid cost model: m = %.2f, predicted cost %.2f per ray\n", best, bestCost);
+	else
+		printf("Grid cost model: m = %.2f, predicted cost %.2f per ray (%.2f with m = 2)\n", best, bestCost, fixedCost);
+	return best;
+}
+
+void Grid::BuildLevels(float factor)
+{
+	vector<uint32_t> ids(getNumObjects());
+	for (int i = 0; i < getNumObjects(); i++) ids[i] = i;
+
+	SetResolution(top, factor, getNumObjects());
+	FillCells(top, ids.data(), ids.size(), pool != NULL && pool->getNumThreads() > 1);
+	if (levels > 1) BuildSubGrids();
+}
+
+void Grid::SetResolution(GridLevel& level, float factor, int count)
+{
+	Vector dim = level.bbox.max - level.bbox.min;
+	float S = pow(count / (dim.x * dim.y * dim.z), 1.0f/3.0f);
+
+	level.nx = trunc(factor * dim.x * S) + 1;
+	level.ny = trunc(factor * dim.y * S) + 1;
+	level.nz = trunc(factor * dim.z * S) + 1;
+}
+
+void Grid::FillCells(GridLevel& level, const uint32_t* ids, int num_objects, bool parallel)
+{
+	AABB& bbox = level.bbox;
+	int nx = level.nx, ny = level.ny, nz = level.nz;
+	Vector dim = bbox.max - bbox.min;
+	int totalcells = nx * ny * nz;
+
+	// cell range covered by the bounding box of every object
+	vector<int> range(6 * num_objects);
+	parallelFor(num_objects, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			const AABB& objBB = boxes[ids[i]];
+			int* r = &range[6 * i];
+
+			r[0] = clamp((int)((objBB.min.x - bbox.min.x) * nx / dim.x), 0, int(nx - 1));
+			r[1] = clamp((int)((objBB.min.y - bbox.min.y) * ny / dim.y), 0, int(ny - 1));
+			r[2] = clamp((int)((objBB.min.z - bbox.min.z) * nz / dim.z), 0, int(nz - 1));
+
+			r[3] = clamp((int)((objBB.max.x - bbox.min.x) * nx / dim.x), 0, int(nx - 1));
+			r[4] = clamp((int)((objBB.max.y - bbox.min.y) * ny / dim.y), 0, int(ny - 1));
+			r[5] = clamp((int)((objBB.max.z - bbox.min.z) * nz / dim.z), 0, int(nz - 1));
+		}
+		});
+
+	// The counts and the scatter go by slabs of z slices: each slab is a range of cells that
+	// only its task writes to. The objects are first bucketed by the slabs they overlap, in
+	// order, so that a task only goes through its own objects and the cells come out as with
+	// one thread.
+	int slabs = parallel ? min(nz, 4 * pool->getNumThreads()) : 1;
+	vector<uint32_t> slabStart(slabs + 1, 0), slabObjects;
+	vector<int> slabOf(nz);   // slab of every z slice
+	auto slabZ = [&](int slab) { return (int)((long long)nz * slab / slabs); };
+
+	if (slabs > 1) {
+		for (int b = 0; b < slabs; b++)
+			for (int iz = slabZ(b); iz < slabZ(b + 1); iz++) slabOf[iz] = b;
+
+		for (int i = 0; i < num_objects; i++)
+			for (int b = slabOf[range[6 * i + 2]]; b <= slabOf[range[6 * i + 5]]; b++) slabStart[b + 1]++;
+		for (int b = 0; b < slabs; b++) slabStart[b + 1] += slabStart[b];
+
+		slabObjects.resize(slabStart[slabs]);
+		vector<uint32_t> next(slabStart.begin(), slabStart.end() - 1);
+		for (int i = 0; i < num_objects; i++)
+			for (int b = slabOf[range[6 * i + 2]]; b <= slabOf[range[6 * i + 5]]; b++) slabObjects[next[b]++] = i;
+	}
+
+	auto forCells = [&](int slab, auto visit) {
+		int z0 = slabZ(slab), z1 = slabZ(slab + 1);
+		int count = slabs > 1 ? slabStart[slab + 1] - slabStart[slab] : num_objects;
+		for (int n = 0; n < count; n++) {
+			int i = slabs > 1 ? slabObjects[slabStart[slab] + n] : n;
+			const int* r = &range[6 * i];
+			for (int iz = max(r[2], z0); iz <= min(r[5], z1 - 1); iz++)
+				for (int iy = r[1]; iy <= r[4]; iy++)
+					for (int ix = r[0]; ix <= r[3]; ix++)
+						visit(ix + nx * iy + nx * ny * iz, i);
+		}
+	};
+
+	// count the objects of each cell, then turn the counts into offsets
+	vector<uint32_t>& cellStart = level.cellStart;
+	cellStart.assign(totalcells + 1, 0);
+	parallelFor(slabs, [&](int begin, int end) {
+		for (int b = begin; b < end; b++)
+			forCells(b, [&](int c, int /*i*/) { cellStart[c + 1]++; });
+		});
+
+	for (int c = 0; c < totalcells; c++)
+		cellStart[c + 1] += cellStart[c];
+
+	// scatter the object indices into their cells
+	level.cellObjects.resize(cellStart[totalcells]);
+	vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+
+	parallelFor(slabs, [&](int begin, int end) {
+		for (int b = begin; b < end; b++)
+			forCells(b, [&](int c, int i) { level.cellObjects[fill[c]++] = ids[i]; });
+		});
+
+	ComputeDistances(level);
+}
+
+// out[i] = min(in[i - 1], in[i], in[i + 1]) along a row of n cells
+static inline void rowMin3(const uint8_t* in, uint8_t* out, int n)
+{
+	for (int i = 0; i < n; i++) {
+		uint8_t v = in[i];
+		if (i > 0 && in[i - 1] < v) v = in[i - 1];
+		if (i + 1 < n && in[i + 1] < v) v = in[i + 1];
+		out[i] = v;
+	}
+}
+
+// a[i] = min(a[i], b[i] + 1): the distances are at most GRID_MAX_DIST, so this does not overflow
+static inline void relax(uint8_t* a, const uint8_t* b, int n)
+{
+	for (int i = 0; i < n; i++)
+		if (b[i] + 1 < a[i]) a[i] = b[i] + 1;
+}
+
+// Chessboard distance transform: a forward and a backward raster scan, each taking the minimum
+// over the 13 neighbours already scanned, plus one, give the exact distance in 3D. The 9 of the
+// previous slice and the 3 of the previous row are taken as 3 x 3 and 3 wide minimum filters.
+void Grid::ComputeDistances(GridLevel& level)
+{
+	int nx = level.nx, ny = level.ny, nz = level.nz;
+	vector<uint8_t>& dist = level.cellDist;
+	dist.resize(nx * ny * nz);
+
+	for (int c = 0; c < nx * ny * nz; c++)
+		dist[c] = level.cellStart[c + 1] > level.cellStart[c] ? 0 : GRID_MAX_DIST;
+
+	vector<uint8_t> rows(nx * ny), slice(nx * ny), row(nx);
+	for (int pass = 0; pass < 2; pass++) {
+		int s = pass == 0 ? 1 : -1;   // scan direction
+		for (int k = 0; k < nz; k++) {
+			int iz = pass == 0 ? k : nz - 1 - k;
+			uint8_t* cur = &dist[nx * ny * iz];
+
+			if (k > 0) {   // the previous slice
+				const uint8_t* prev = cur - s * nx * ny;
+				for (int iy = 0; iy < ny; iy++)
+					rowMin3(prev + nx * iy, &rows[nx * iy], nx);
+				for (int iy = 0; iy < ny; iy++) {
+					uint8_t* out = &slice[nx * iy];
+					copy(&rows[nx * iy], &rows[nx * iy] + nx, out);
+					for (int x = 0; x < nx; x++) {
+						if (iy > 0 && rows[nx * (iy - 1) + x] < out[x]) out[x] = rows[nx * (iy - 1) + x];
+						if (iy + 1 < ny && rows[nx * (iy + 1) + x] < out[x]) out[x] = rows[nx * (iy + 1) + x];
+					}
+				}
+				relax(cur, slice.data(), nx * ny);
+			}
+
+			for (int j = 0; j < ny; j++) {
+				int iy = pass == 0 ? j : ny - 1 - j;
+				uint8_t* r = cur + nx * iy;
+
+				if (j > 0) {   // the previous row
+					rowMin3(r - s * nx, row.data(), nx);
+					relax(r, row.data(), nx);
+				}
+
+				// the previous cell of the row
+				if (pass == 0) {
+					for (int x = 1; x < nx; x++)
+						if (r[x - 1] + 1 < r[x]) r[x] = r[x - 1] + 1;
+				}
+				else {
+					for (int x = nx - 2; x >= 0; x--)
+						if (r[x + 1] + 1 < r[x]) r[x] = r[x + 1] + 1;
+				}
+			}
+		}
+	}
+}
+
+// Moves one axis of a walk across the cells whose boundary comes before t, at most n of them;
+// false if the ray leaves the grid
+static inline bool skipAxis(float t, int n, float& t_next, double dt, float& index, float i_step, float i_stop)
+{
+	for (; n > 0 && t_next < t; n--) {
+		t_next += dt;
+		index += i_step;
+		if (index == i_stop) return false;
+	}
+	return true;
+}
+
+// Parameter at which the ray leaves the cube of the cells within n of the current one
+static inline float skipExit(const Vector& t_next, double dtx, double dty, double dtz, int n)
+{
+	float tx = t_next.x == numeric_limits<float>::max() ? t_next.x : (float)(t_next.x + n * dtx);
+	float ty = t_next.y == numeric_limits<float>::max() ? t_next.y : (float)(t_next.y + n * dty);
+	float tz = t_next.z == numeric_limits<float>::max() ? t_next.z : (float)(t_next.z + n * dtz);
+	return MIN3(tx, ty, tz);
+}
+
+// The sub-grid of a dense cell covers the box of the cell, with a resolution that follows from the
+// number of objects in it. Objects reaching out of the cell are clamped to its border cells: the
+// walk of the top grid only goes down into the sub-grid for the part of the ray inside the cell.
+void Grid::BuildSubGrids()
+{
+	int nx = top.nx, ny = top.ny, nz = top.nz;
+	Vector dim = top.bbox.max - top.bbox.min;
+	Vector cell = Vector(dim.x / nx, dim.y / ny, dim.z / nz);
+
+	sub.clear();
+	top.cellChild.assign(nx * ny * nz, -1);
+
+	vector<int> cells;   // top cell of every sub-grid
+	for (int iz = 0; iz < nz; iz++)
+		for (int iy = 0; iy < ny; iy++)
+			for (int ix = 0; ix < nx; ix++) {
+				int c = ix + nx * iy + nx * ny * iz;
+				int count = top.cellStart[c + 1] - top.cellStart[c];
+				if (count <= GRID_DENSE_CELL) continue;
+
+				GridLevel level;
+				level.bbox.min = top.bbox.min + Vector(ix * cell.x, iy * cell.y, iz * cell.z);
+				level.bbox.max = level.bbox.min + cell;
+				SetResolution(level, GRID_SUB_M, count);
+				if (level.nx * level.ny * level.nz == 1) continue;
+
+				top.cellChild[c] = sub.size();
+				sub.push_back(level);
+				cells.push_back(c);
+			}
+
+	// one sub-grid per task, whose own fill then runs on that thread
+	parallelFor(sub.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			int c = cells[i];
+			FillCells(sub[i], &top.cellObjects[top.cellStart[c]], top.cellStart[c + 1] - top.cellStart[c], false);
+		}
+		});
+}
+
+void Grid::Init_Traverse(float dx, float& index, double& dtx, float& t_next, float& i_step, float& i_stop, float& tmin, float& tmax, int nx) {
+	if (dx > 0) {
+		t_next = tmin + (index + 1) * dtx;
+		i_step = +1;
+		i_stop = nx;
+	}
+	else {
+		t_next = tmin + (nx - index) * dtx;
+		i_step = -1;
+		i_stop = -1;
+	}
+
+	if (dx == 0.0) {
+		t_next = numeric_limits<float>::max();
+		i_step = -1;
+		i_stop = -1;
+	}
+}
+
+bool Grid::Traverse(Ray& ray, HitRecord& hit)
+{
+	hit.t = INFINITY;
+	bool found = IntersectUnbounded(ray, hit.t, hit.prim);
+	if (FindHit(ray, hit.t, hit.prim)) found = true;
+	if (!found) return false;
+	scene->CompleteHit(ray, hit);
+	return true;
+}
+
+bool Grid::FindHit(Ray& ray, float& tNear, PrimRef& hit)
+{
+	if (objects.empty()) return false;
+
+	Mailbox& mb = NewMailboxRay(getNumObjects());
+	return WalkHit(top, ray, tNear, hit, mb, RayStats::local(), 0.0f);
+}
+
+bool Grid::WalkHit(const GridLevel& level, Ray& ray, float& tNear, PrimRef& hit, Mailbox& mb, RayStats& stats, float tStart)
+{
+	const AABB& bbox = level.bbox;
+	int nx = level.nx, ny = level.ny, nz = level.nz;
+
+	float ox = ray.origin.x; float oy = ray.origin.y; float oz = ray.origin.z;
+	float dx = ray.direction.x; float dy = ray.direction.y; float dz = ray.direction.z;
+
+	Vector tmin;
+	Vector tmax;
+
+	float t0 = numeric_limits<float>::min();
+	float t1 = numeric_limits<float>::max();
+
+	if (!bbox.intercepts(ray, t0, t1, tmin, tmax)) return false;
+	
+	Vector index; //starting cell indices
+
+	// a walk resumed at tStart starts from the cell the ray is in there
+	if (tStart > 0.0f && tStart > t0) {
+		Vector p = ray.origin + ray.direction * tStart;
+		index.x = clamp((int)((p.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
+		index.y = clamp((int)((p.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
+		index.z = clamp((int)((p.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
+	}
+	// checks if ray starts inside the grid
+	else if (bbox.isInside(ray.origin)) {
+		index.x = clamp((int)((ox - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
+		index.y = clamp((int)((oy - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
+		index.z = clamp((int)((oz - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
+	}
+	else {
+		// initial hit point with grid's bounding box
+		Vector p = ray.origin + ray.direction * t0;
+		index.x = clamp((int)((p.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
+		index.y = clamp((int)((p.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
+		index.z = clamp((int)((p.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
+	}
+
+	// ray parameter increments per cell in the x, y, and z directions
+	double dtx = (tmax.x - tmin.x) / nx;
+	double dty = (tmax.y - tmin.y) / ny;
+	double dtz = (tmax.z - tmin.z) / nz;
+
+	Vector t_next, i_step, i_stop;
+
+	Init_Traverse(dx, index.x, dtx, t_next.x, i_step.x, i_stop.x, tmin.x, tmax.x, nx);
+	Init_Traverse(dy, index.y, dty, t_next.y, i_step.y, i_stop.y, tmin.y, tmax.y, ny);
+	Init_Traverse(dz, index.z, dtz, t_next.z, i_step.z, i_stop.z, tmin.z, tmax.z, nz);
+
+	// closest hit so far, starting from the one given in tNear; it may lie beyond the current
+	// cell, so it is kept across cells
+	bool hitobject = false;
+	float tNearaux = tNear;
+	PrimRef batch[GRID_BATCH];
+
+	// Traverse the grid
+	while (true) {
+		int cellIndex = index.x + nx * index.y + nx * ny * index.z;
+		stats.cells++;
+
+		// empty space: go to the last cell along the ray of the empty cube around this one, then
+		// step out of it as from any cell
+		int d = level.cellDist[cellIndex];
+		if (d > 1) {
+			float t_exit = skipExit(t_next, dtx, dty, dtz, d - 1);
+			if (tNearaux < t_exit) return hitobject;
+			if (!skipAxis(t_exit, d - 1, t_next.x, dtx, index.x, i_step.x, i_stop.x) ||
+				!skipAxis(t_exit, d - 1, t_next.y, dty, index.y, i_step.y, i_stop.y) ||
+				!skipAxis(t_exit, d - 1, t_next.z, dtz, index.z, i_step.z, i_stop.z))
+				return hitobject;
+		}
+		else if (!level.cellChild.empty() && level.cellChild[cellIndex] >= 0) {
+			if (WalkHit(sub[level.cellChild[cellIndex]], ray, tNearaux, hit, mb, stats, tStart)) {
+				hitobject = true;
+				tNear = tNearaux;
+			}
+		}
+		else {
+			// checks intercection with the objects not tested yet, gathered in batches that keep
+			// the cell sorted by set
+			uint32_t i = level.cellStart[cellIndex], end = level.cellStart[cellIndex + 1];
+			while (i < end) {
+				int n = 0;
+				for (; i < end && n < GRID_BATCH; i++) {
+					uint32_t id = level.cellObjects[i];
+					if (mb.stamp[id] == mb.rayId) {
+						stats.mailboxSkips++;
+						continue;
+					}
+					mb.stamp[id] = mb.rayId;
+					batch[n++] = objects[id];
+				}
+				stats.objectTests += n;
+
+				if (scene->Intersect(batch, n, ray, tNearaux, hit)) {
+					hitobject = true;
+					tNear = tNearaux;
+				}
+			}
+		}
+		
+		if (t_next.x < t_next.y && t_next.x < t_next.z) {
+			if (tNearaux < t_next.x) return hitobject;
+			t_next.x += dtx;
+			index.x += i_step.x;
+
+			if (index.x == i_stop.x)
+				return hitobject;
+		}
+		else {
+			if (t_next.y < t_next.z) {
+				if (tNearaux < t_next.y) return hitobject;
+				t_next.y += dty;
+				index.y += i_step.y;
+
+				if (index.y == i_stop.y)
+					return hitobject;
+			}
+			else {
+				if (tNearaux < t_next.z) return hitobject;
+				t_next.z += dtz;
+				index.z += i_step.z;
+
+				if (index.z == i_stop.z)
+					return hitobject;
+			}
+		}
+	}
+}
+
+bool Grid::Occluded(Ray& ray, float maxDist) {
+	if (OccludedUnbounded(ray, maxDist)) return true;
+	if (objects.empty()) return false;
+
+	Mailbox& mb = NewMailboxRay(getNumObjects());
+	return WalkOccluded(top, ray, maxDist, mb, RayStats::local(), 0.0f);
+}
+
+// Same walk as WalkHit(), which returns at the first object hit nearer than maxDist and stops
+// at the first cell that starts beyond it
+bool Grid::WalkOccluded(const GridLevel& level, Ray& ray, float maxDist, Mailbox& mb, RayStats& stats, float tStart) {
+	const AABB& bbox = level.bbox;
+	int nx = level.nx, ny = level.ny, nz = level.nz;
+
+	float ox = ray.origin.x; float oy = ray.origin.y; float oz = ray.origin.z;
+	float dx = ray.direction.x; float dy = ray.direction.y; float dz = ray.direction.z;
+
+	Vector tmin;
+	Vector tmax;
+
+	float t0 = numeric_limits<float>::min();
+	float t1 = numeric_limits<float>::max();
+
+	if (!bbox.intercepts(ray, t0, t1, tmin, tmax) || t0 >= maxDist) return false;
+
+	Vector index; //starting cell indices
+
+	if (tStart > 0.0f && tStart > t0) {  		// does the walk resume at tStart?
+		Vector p = ray.origin + ray.direction * tStart;
+		index.x = clamp((int)((p.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
+		index.y = clamp((int)((p.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
+		index.z = clamp((int)((p.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
+	}
+	else if (bbox.isInside(ray.origin)) {  			// does the ray start inside the grid?
+		index.x = clamp((int)((ox - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
+		index.y = clamp((int)((oy - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
+		index.z = clamp((int)((oz - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
+	}
+	else {
+		Vector p = ray.origin + ray.direction * t0;  // initial hit point with grid's bounding box
+		index.x = clamp((int)((p.x - bbox.min.x) * nx / (bbox.max.x - bbox.min.x)), 0, int(nx - 1));
+		index.y = clamp((int)((p.y - bbox.min.y) * ny / (bbox.max.y - bbox.min.y)), 0, int(ny - 1));
+		index.z = clamp((int)((p.z - bbox.min.z) * nz / (bbox.max.z - bbox.min.z)), 0, int(nz - 1));
+	}
+
+	// ray parameter increments per cell in the x, y, and z directions
+
+	double dtx = (tmax.x - tmin.x) / nx;
+	double dty = (tmax.y - tmin.y) / ny;
+	double dtz = (tmax.z - tmin.z) / nz;
+
+	Vector t_next, i_step, i_stop;
+
+	Init_Traverse(dx, index.x, dtx, t_next.x, i_step.x, i_stop.x, tmin.x, tmax.x, nx);
+	Init_Traverse(dy, index.y, dty, t_next.y, i_step.y, i_stop.y, tmin.y, tmax.y, ny);
+	Init_Traverse(dz, index.z, dtz, t_next.z, i_step.z, i_stop.z, tmin.z, tmax.z, nz);
+
+	PrimRef batch[GRID_BATCH];
+
+	while (true) {
+		int cellIndex = index.x + nx * index.y + nx * ny * index.z;
+		stats.shadowCells++;
+
+		int d = level.cellDist[cellIndex];
+		if (d > 1) {
+			float t_exit = skipExit(t_next, dtx, dty, dtz, d - 1);
+			if (t_exit >= maxDist) return false;
+			if (!skipAxis(t_exit, d - 1, t_next.x, dtx, index.x, i_step.x, i_stop.x) ||
+				!skipAxis(t_exit, d - 1, t_next.y, dty, index.y, i_step.y, i_stop.y) ||
+				!skipAxis(t_exit, d - 1, t_next.z, dtz, index.z, i_step.z, i_stop.z))
+				return false;
+		}
+		else if (!level.cellChild.empty() && level.cellChild[cellIndex] >= 0) {
+			if (WalkOccluded(sub[level.cellChild[cellIndex]], ray, maxDist, mb, stats, tStart)) return true;
+		}
+		else {
+			uint32_t i = level.cellStart[cellIndex], end = level.cellStart[cellIndex + 1];
+			while (i < end) {
+				int n = 0;
+				for (; i < end && n < GRID_BATCH; i++) {
+					uint32_t id = level.cellObjects[i];
+					if (mb.stamp[id] == mb.rayId) {
+						stats.mailboxSkips++;
+						continue;
+					}
+					mb.stamp[id] = mb.rayId;
+					batch[n++] = objects[id];
+				}
+				stats.objectTests += n;
+				stats.shadowTests += n;
+
+				if (scene->Occluded(batch, n, ray, maxDist)) return true;
+			}
+		}
+
+		if (t_next.x < t_next.y && t_next.x < t_next.z) {
+			if (t_next.x >= maxDist) return false;
+			t_next.x += dtx;
+			index.x += i_step.x;
+
+			if (index.x == i_stop.x)
+				return false;
+		}
+		else {
+			if (t_next.y < t_next.z) {
+				if (t_next.y >= maxDist) return false;
+				t_next.y += dty;
+				index.y += i_step.y;
+
+				if (index.y == i_stop.y)
+					return false;
+			}
+			else {
+				if (t_next.z >= maxDist) return false;
+				t_next.z += dtz;
+				index.z += i_step.z;
+
+				if (index.z == i_stop.z)
+					return false;
+			}
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////// Packets
+
+// A packet whose rays all go the same way along one axis walks the grid slice by slice along
+// it: in every slice the cells of the rectangle covering the parts of the rays inside the slice
+// are visited once for the whole packet, and their objects are intersected with every active
+// ray. A ray leaves the packet once the next slice starts beyond its closest hit (or its light),
+// as every cell before that point has been visited; the last ray left finishes alone.
+
+#define GRID_PACKET_PAD 1e-3f   // margin of the slice rectangles, in cells, for rounding errors
+
+struct Grid::PacketWalk {
+	Ray* rays;
+	int count;
+	bool shadow;
+	int axis;                   // the slices are perpendicular to it
+	float tmax[PACKET_SIZE];    // closest hit so far, or distance to the light
+	PrimRef* prims[PACKET_SIZE];
+	uint32_t active;            // rays that may still find a closer hit or a blocker
+	uint32_t found;             // rays with a hit, or blocked
+	Mailbox* mb;
+	RayStats* stats;
+};
+
+static inline float axisOf(const Vector& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Axis of the largest direction component of the first ray, or -1 when the rays do not all
+// move the same way along it
+static int packetAxis(Ray* rays, int count)
+{
+	const Vector& d = rays[0].direction;
+	int axis = fabs(d.x) >= fabs(d.y) ? (fabs(d.x) >= fabs(d.z) ? 0 : 2) : (fabs(d.y) >= fabs(d.z) ? 1 : 2);
+	float sign = axisOf(d, axis);
+	for (int i = 0; i < count; i++) {
+		float di = axisOf(rays[i].direction, axis);
+		if (di == 0.0f || (di > 0.0f) != (sign > 0.0f)) return -1;
+	}
+	return axis;
+}
+
+void Grid::TraversePacket(Ray* rays, int count, HitRecord* hits, bool* hitObject)
+{
+	int axis = objects.empty() || count < 2 ? -1 : packetAxis(rays, count);
+	if (axis < 0) {
+		Accelerator::TraversePacket(rays, count, hits, hitObject);
+		return;
+	}
+
+	PacketWalk pw;
+	pw.rays = rays;
+	pw.count = count;
+	pw.shadow = false;
+	pw.axis = axis;
+	pw.found = 0;
+	for (int i = 0; i < count; i++) {
+		pw.tmax[i] = INFINITY;
+		pw.prims[i] = &hits[i].prim;
+		if (IntersectUnbounded(rays[i], pw.tmax[i], hits[i].prim)) pw.found |= 1u << i;
+	}
+	pw.active = (1u << count) - 1u;
+	pw.mb = &NewMailboxRay(getNumObjects());
+	pw.stats = &RayStats::local();
+
+	WalkPacket(top, pw, pw.active, true);
+
+	for (int i = 0; i < count; i++) {
+		hitObject[i] = (pw.found & (1u << i)) != 0;
+		if (!hitObject[i]) continue;
+		hits[i].t = pw.tmax[i];
+		scene->CompleteHit(rays[i], hits[i]);
+	}
+}
+
+void Grid::OccludedPacket(Ray* rays, const float* maxDist, int count, bool* occluded)
+{
+	int axis = objects.empty() || count < 2 ? -1 : packetAxis(rays, count);
+	if (axis < 0) {
+		Accelerator::OccludedPacket(rays, maxDist, count, occluded);
+		return;
+	}
+
+	PacketWalk pw;
+	pw.rays = rays;
+	pw.count = count;
+	pw.shadow = true;
+	pw.axis = axis;
+	pw.found = 0;
+	for (int i = 0; i < count; i++) {
+		pw.tmax[i] = maxDist[i];
+		if (OccludedUnbounded(rays[i], maxDist[i])) pw.found |= 1u << i;
+	}
+	pw.active = ((1u << count) - 1u) & ~pw.found;
+	pw.mb = &NewMailboxRay(getNumObjects());
+	pw.stats = &RayStats::local();
+
+	if (pw.active) WalkPacket(top, pw, pw.active, true);
+
+	for (int i = 0; i < count; i++)
+		occluded[i] = (pw.found & (1u << i)) != 0;
+}
+
+// mask: the rays of the packet crossing the level. Only the walk of the top level takes rays
+// out of the packet: in a sub-grid, other cells of the current top slice may still lie before
+// the hit of a ray.
+void Grid::WalkPacket(const GridLevel& level, PacketWalk& pw, uint32_t mask, bool isTop)
+{
+	if (!mask) return;
+
+	const AABB& bbox = level.bbox;
+	int n[3] = { level.nx, level.ny, level.nz };
+	int k = pw.axis, u = (k + 1) % 3, v = (k + 2) % 3;
+	float lo[3] = { bbox.min.x, bbox.min.y, bbox.min.z };
+	float size[3] = { (bbox.max.x - bbox.min.x) / n[0], (bbox.max.y - bbox.min.y) / n[1], (bbox.max.z - bbox.min.z) / n[2] };
+	bool forward = axisOf(pw.rays[firstLane(mask)].direction, k) > 0.0f;
+
+	// part of every ray inside the level, and the slice the packet starts in
+	float tIn[PACKET_SIZE], tOut[PACKET_SIZE], tSlice[PACKET_SIZE];
+	int first = forward ? n[k] - 1 : 0;
+	for (int i = 0; i < pw.count; i++) {
+		if (!(mask & (1u << i))) continue;
+		float t0, t1;
+		Vector tmin, tmax;
+		if (!bbox.intercepts(pw.rays[i], t0, t1, tmin, tmax)) {
+			mask &= ~(1u << i);
+			continue;
+		}
+		tIn[i] = max(t0, 0.0f);
+		tOut[i] = t1;
+		float p = axisOf(pw.rays[i].origin, k) + axisOf(pw.rays[i].direction, k) * tIn[i];
+		int s = clamp((int)((p - lo[k]) / size[k]), 0, n[k] - 1);
+		first = forward ? min(first, s) : max(first, s);
+	}
+	if (isTop) pw.active &= mask;
+
+	for (int s = first; mask && s >= 0 && s < n[k]; s += forward ? 1 : -1) {
+		mask &= pw.active;   // blocked shadow rays are done
+
+		// rectangle of the cells of the slice crossed by the rays
+		float u0 = INFINITY, u1 = -INFINITY, v0 = INFINITY, v1 = -INFINITY;
+		for (int i = 0; i < pw.count; i++) {
+			if (!(mask & (1u << i))) continue;
+			const Ray& r = pw.rays[i];
+			float o = axisOf(r.origin, k), inv = 1.0f / axisOf(r.direction, k);
+			float ta = (lo[k] + s * size[k] - o) * inv, tb = (lo[k] + (s + 1) * size[k] - o) * inv;
+			if (ta > tb) swap(ta, tb);
+			tSlice[i] = ta;
+
+			float end = min(tOut[i], pw.tmax[i]);
+			if (ta > end) {   // the ray is done with this level
+				mask &= ~(1u << i);
+				continue;
+			}
+			float ts0 = max(ta, tIn[i]), ts1 = min(tb, end);
+			if (ts0 > ts1) continue;   // enters the level in a later slice
+
+			float pu0 = axisOf(r.origin, u) + axisOf(r.direction, u) * ts0, pu1 = axisOf(r.origin, u) + axisOf(r.direction, u) * ts1;
+			float pv0 = axisOf(r.origin, v) + axisOf(r.direction, v) * ts0, pv1 = axisOf(r.origin, v) + axisOf(r.direction, v) * ts1;
+			u0 = min(u0, min(pu0, pu1)); u1 = max(u1, max(pu0, pu1));
+			v0 = min(v0, min(pv0, pv1)); v1 = max(v1, max(pv0, pv1));
+		}
+		if (isTop) {
+			pw.active &= mask;
+			if (countLanes(pw.active) == 1) {
+				// the packet has diverged: its last ray goes on alone from this slice, skipping the
+				// objects it has tested
+				int i = firstLane(pw.active);
+				float t = max(tSlice[i], tIn[i]);
+				if (pw.shadow) {
+					if (WalkOccluded(top, pw.rays[i], pw.tmax[i], *pw.mb, *pw.stats, t)) pw.found |= 1u << i;
+				}
+				else if (WalkHit(top, pw.rays[i], pw.tmax[i], *pw.prims[i], *pw.mb, *pw.stats, t))
+					pw.found |= 1u << i;
+				return;
+			}
+		}
+		if (u0 > u1) continue;
+
+		int iu0 = clamp((int)floor((u0 - lo[u]) / size[u] - GRID_PACKET_PAD), 0, n[u] - 1);
+		int iu1 = clamp((int)floor((u1 - lo[u]) / size[u] + GRID_PACKET_PAD), 0, n[u] - 1);
+		int iv0 = clamp((int)floor((v0 - lo[v]) / size[v] - GRID_PACKET_PAD), 0, n[v] - 1);
+		int iv1 = clamp((int)floor((v1 - lo[v]) / size[v] + GRID_PACKET_PAD), 0, n[v] - 1);
+
+		int idx[3];
+		idx[k] = s;
+		for (idx[v] = iv0; idx[v] <= iv1; idx[v]++)
+			for (idx[u] = iu0; idx[u] <= iu1; idx[u]++) {
+				int cellIndex = idx[0] + n[0] * idx[1] + n[0] * n[1] * idx[2];
+				(pw.shadow ? pw.stats->shadowCells : pw.stats->cells)++;
+				if (level.cellDist[cellIndex] > 0) continue;   // empty
+
+				if (!level.cellChild.empty() && level.cellChild[cellIndex] >= 0)
+					WalkPacket(sub[level.cellChild[cellIndex]], pw, mask & pw.active, false);
+				else
+					TestPacket(level, cellIndex, pw);
+				if (!pw.active) return;
+			}
+	}
+}
+
+// Objects of a cell not tested by the packet yet, against all its active rays: an object is
+// stamped once for the whole packet, so it must not be left untested for any ray still traced
+void Grid::TestPacket(const GridLevel& level, int cellIndex, PacketWalk& pw)
+{
+	Mailbox& mb = *pw.mb;
+	RayStats& stats = *pw.stats;
+	PrimRef batch[GRID_BATCH];
+
+	uint32_t i = level.cellStart[cellIndex], end = level.cellStart[cellIndex + 1];
+	while (i < end && pw.active) {
+		int n = 0;
+		for (; i < end && n < GRID_BATCH; i++) {
+			uint32_t id = level.cellObjects[i];
+			if (mb.stamp[id] == mb.rayId) {
+				stats.mailboxSkips++;
+				continue;
+			}
+			mb.stamp[id] = mb.rayId;
+			batch[n++] = objects[id];
+		}
+
+		for (int r = 0; r < pw.count; r++) {
+			if (!(pw.active & (1u << r))) continue;
+			stats.objectTests += n;
+			if (pw.shadow) {
+				stats.shadowTests += n;
+				if (scene->Occluded(batch, n, pw.rays[r], pw.tmax[r])) {
+					pw.found |= 1u << r;
+					pw.active &= ~(1u << r);
+				}
+			}
+			else if (scene->Intersect(batch, n, pw.rays[r], pw.tmax[r], *pw.prims[r]))
+				pw.found |= 1u << r;
+		}
+	}
+}
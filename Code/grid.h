@@ -1,42 +1,93 @@
-#ifndef GRID_H
-#define GRID_H
-
-#include <vector>
-#include <cmath>
-#include "scene.h"
-
-using namespace std;
-
-class Grid
-{
-public:
-	Grid(vector<Object*>);
-	//~Grid(void);
-
-	int getNumObjects();
-	void addObject(Object* o);
-	Object* getObject(unsigned int index);
-
-	int getNumCells();
-
-	void Build();   // set up grid cells
-
-	Object* Traverse(Ray& ray, float& t); 
-	bool TraverseShadow(Ray& ray); //Traverse for shadow ray
-
-private:
-	vector<Object *> objects;
-	vector<vector<Object*> > cells;
-
-	int nx, ny, nz; // number of cells in the x, y, and z directions
-	float m = 2.0f; // factor that allows to vary the number of cells
-
-	Vector find_min_bounds(void);
-	Vector find_max_bounds(void);
-
-	//Setup function for Grid traversal
-	void Init_Traverse(float dx, float& index, double& dtx, float& t_next, float& i_step, float& i_stop, float& tmin, float& tmax, int nx);
-
-	AABB bbox;
-};
-#endif
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include "scene.h"
+#include "accelerator.h"
+
+using namespace std;
+
+struct Mailbox;
+
+class Grid : public Accelerator
+{
+public:
+	// m = 0 picks the resolution with the cost model; with two levels, the dense cells of the
+	// grid hold grids of their own
+	Grid(Scene* scene, ThreadPool* pool = NULL, float m = 0.0f, int levels = 1);
+	//~Grid(void);
+
+	int getNumObjects();
+	const PrimRef& getObject(unsigned int index);
+
+	int getNumCells();
+	size_t getMemoryUsage();   // bytes used by the cell arrays
+
+	void Build();   // set up grid cells
+
+	bool Traverse(Ray& ray, HitRecord& hit);
+	bool Occluded(Ray& ray, float tmax);
+
+	void TraversePacket(Ray* rays, int count, HitRecord* hits, bool* hit);
+	void OccludedPacket(Ray* rays, const float* tmax, int count, bool* occluded);
+
+	// A uniform grid over bbox, with its cells stored in compressed sparse row layout: the objects
+	// of cell c are objects[cellObjects[i]] for cellStart[c] <= i < cellStart[c + 1]. objects is
+	// sorted by set and scattered in order, so every cell is sorted by set too. The cells of the
+	// top level that hold a sub-grid have its index in cellChild, the others -1. cellDist is the
+	// Chebyshev distance, in cells, from every cell to the nearest non-empty one: the walks jump
+	// across the empty cells around a cell at distance d > 1 (d - 1 cells in every direction).
+	struct GridLevel {
+		AABB bbox;
+		int nx, ny, nz; // number of cells in the x, y, and z directions
+		vector<uint32_t> cellStart;
+		vector<uint32_t> cellObjects;
+		vector<int> cellChild;
+		vector<uint8_t> cellDist;   // at most GRID_MAX_DIST
+	};
+
+protected:
+	uint32_t fileTag();
+	void SaveData(AccelWriter& out);
+	bool LoadData(AccelReader& in);
+
+private:
+	vector<PrimRef> objects;   // the bounded primitives of the scene
+	vector<AABB> boxes;        // and their bounding boxes
+
+	GridLevel top;
+	vector<GridLevel> sub;   // sub-grids of the dense cells of top
+
+	float m;        // factor that allows to vary the number of cells
+	int levels;
+
+	Vector find_min_bounds(void);
+	Vector find_max_bounds(void);
+
+	float ChooseFactor(void);          // the m of the cheapest grid for the camera rays
+	void BuildLevels(float m);
+	void SetResolution(GridLevel& level, float m, int count);   // nx, ny and nz for count objects
+	// cell arrays of the objects ids; parallel for a level filled by the tasks of the pool
+	void FillCells(GridLevel& level, const uint32_t* ids, int count, bool parallel);
+	void BuildSubGrids(void);
+	void ComputeDistances(GridLevel& level);
+	void PrintLevels(void);
+
+	bool FindHit(Ray& ray, float& t, PrimRef& hit);   // t and primitive of the closest hit nearer than t
+
+	// 3D-DDA walks of one level, which go down into the sub-grids of the cells they cross. They
+	// start where the ray enters the level, or at tStart when a walk resumes further along the ray
+	bool WalkHit(const GridLevel& level, Ray& ray, float& t, PrimRef& hit, Mailbox& mb, RayStats& stats, float tStart);
+	bool WalkOccluded(const GridLevel& level, Ray& ray, float maxDist, Mailbox& mb, RayStats& stats, float tStart);
+
+	// Slice walk of a packet through one level (see TraversePacket())
+	struct PacketWalk;
+	void WalkPacket(const GridLevel& level, PacketWalk& pw, uint32_t mask, bool isTop);
+	void TestPacket(const GridLevel& level, int cellIndex, PacketWalk& pw);
+
+	//Setup function for Grid traversal
+	void Init_Traverse(float dx, float& index, double& dtx, float& t_next, float& i_step, float& i_stop, float& tmin, float& tmax, int nx);
+};
+#endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "primitives.h"
+#include "rayKernels.h"
+#include "sampler.h"
+
+using namespace std;
+
+// Microbenchmark of the intersection kernels: traces random rays through a cloud of random
+// triangles and one of random spheres, in runs of --batch references as the grid cells and BVH
+// leaves do, with every kernel the CPU supports. Reports the ray/primitive tests per second of
+// each one and checks that they find the same hits as the scalar kernel.
+
+static Vector randomPoint(PCG32& rng, float size)
+{
+	float x = rng.nextFloat(), y = rng.nextFloat(), z = rng.nextFloat();
+	return Vector(x * size, y * size, z * size);
+}
+
+// Closest hits of every ray with set, for each kernel
+template <typename Set> static void benchmark(const char* name, Set& set, int count, vector<Ray>& rays, int batch)
+{
+	vector<PrimRef> refs(count);
+	for (int i = 0; i < count; i++) {
+		refs[i].set = 0;
+		refs[i].prim = i;
+	}
+
+	vector<int> reference;
+	KernelType best = bestKernel();
+	for (int k = KERNEL_SCALAR; k <= best; k++) {
+		setKernel((KernelType)k);
+
+		vector<int> hits(rays.size());
+		int numHits = 0;
+		auto start = chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < rays.size(); i++) {
+			float t = INFINITY;
+			hits[i] = -1;
+			for (int first = 0; first < count; first += batch) {
+				int n = set.Closest(&refs[first], count - first < batch ? count - first : batch, rays[i], t);
+				if (n >= 0) hits[i] = first + n;
+			}
+			numHits += hits[i] >= 0;
+		}
+		auto end = chrono::high_resolution_clock::now();
+		double seconds = chrono::duration<double>(end - start).count();
+
+		if (k == KERNEL_SCALAR) reference = hits;
+		printf("%-8s  %-6s  %8.1f M tests/s  %6d hits  %s\n", name, kernel_names[k],
+			(double)rays.size() * count / seconds * 1e-6, numHits, hits == reference ? "same as scalar" : "DIFFERENT FROM SCALAR");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int numPrimitives = 4096, numRays = 4096, batch = 64;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--primitives")) numPrimitives = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--rays")) numRays = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--batch")) batch = atoi(argv[i + 1]);
+	}
+	if (argc % 2 == 0 || numPrimitives < 1 || numRays < 1 || batch < 1) {
+		printf("Usage: %s [--primitives n] [--rays n] [--batch n]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// primitives of about a tenth of the unit cube, so that most rays hit a few of them
+	PCG32 rng(0, 0, 1);
+	TriangleMesh mesh(NULL);
+	SphereSet spheres;
+	for (int i = 0; i < numPrimitives; i++) {
+		Vector p = randomPoint(rng, 1.0f);
+		uint32_t v0 = mesh.addVertex(p);
+		uint32_t v1 = mesh.addVertex(p + randomPoint(rng, 0.1f));
+		uint32_t v2 = mesh.addVertex(p + randomPoint(rng, 0.1f));
+		mesh.addTriangle(v0, v1, v2);
+		spheres.add(randomPoint(rng, 1.0f), 0.02f + 0.03f * rng.nextFloat(), NULL);
+	}
+
+	// rays from outside the cube through a random point in it
+	vector<Ray> rays;
+	for (int i = 0; i < numRays; i++) {
+		Vector origin = randomPoint(rng, 4.0f) - Vector(1.5f, 1.5f, -2.0f);
+		Vector dir = (randomPoint(rng, 1.0f) - origin).normalize();
+		rays.push_back(Ray(origin, dir));
+	}
+
+	benchmark("triangle", mesh, numPrimitives, rays, batch);
+	benchmark("sphere", spheres, numPrimitives, rays, batch);
+	return EXIT_SUCCESS;
+}
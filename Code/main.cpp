@@ -1,776 +1,1414 @@
-///////////////////////////////////////////////////////////////////////
-//
-// P3D Course
-// (c) 2019 by João Madeiras Pereira
-//Ray Tracing P3F scenes and drawing points with Modern OpenGL
-//
-///////////////////////////////////////////////////////////////////////
-
-#include <stdlib.h>
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string.h>
-#include <stdio.h>
-#include <time.h>
-#include <chrono>
-#include <conio.h>
-
-#include <GL/glew.h>
-#include <GL/freeglut.h>
-#include <IL/il.h>
-
-#include "scene.h"
-#include "grid.h"
-#include "maths.h"
-#include "sampler.h"
-
-#define CAPTION "Whitted Ray-Tracer"
-
-#define VERTEX_COORD_ATTRIB 0
-#define COLOR_ATTRIB 1
-
-#define MAX_DEPTH 4
-
-//antialiasing
-bool ANTIALIASING = false;
-#define SPP_N 4
-
-//Depth of Field
-bool DOF = false;
-
-//Soft shadows
-bool SOFTSHADOWS = false;
-#define SL_N 8 //N source points for Area Light
-
-//Skybox
-bool SKYBOX = false;
-
-//Grid
-bool HASGRID = false;
-
-//Enable OpenGL drawing.  
-bool drawModeEnabled = true;
-
-//Draw Mode: 0 - point by point; 1 - line by line; 2 - full frame at once
-int draw_mode = 1;
-
-// Points defined by 2 attributes: positions which are stored in vertices array and colors which are stored in colors array
-float* colors;
-float* vertices;
-int size_vertices;
-int size_colors;
-
-//Array of Pixels to be stored in a file by using DevIL library
-uint8_t* img_Data;
-
-GLfloat m[16];  //projection matrix initialized by ortho function
-
-GLuint VaoId;
-GLuint VboId[2];
-
-GLuint VertexShaderId, FragmentShaderId, ProgramId;
-GLint UniformId;
-
-Scene* scene = NULL;
-Grid* grid = NULL;
-int RES_X, RES_Y;
-
-int WindowHandle = 0;
-
-Vector refract(Vector rayDirection, Vector normal, float eta_in, float eta_out) {
-	float eta = eta_in / eta_out;
-
-	Vector t, vt, direction;
-	float sin, cos;
-	Vector negDirection = rayDirection * (-1);
-	vt = normal * (negDirection * normal) - negDirection;
-	sin = eta * vt.length(); // sin = ||vt||
-
-	cos = sqrt(max(0.0f, 1.0f - (double)sin * sin));
-	t = vt / vt.length(); // t = (1/||vt||) * vt
-	direction = t * sin + (normal * (-1)) * cos;
-
-	return direction;
-}
-
-float fresnel(Vector rayDirection, Vector normal, float eta_in, float eta_out) {
-	float kr;
-	float cosi = clamp(-1, 1, rayDirection * normal);
-	float etai = 1, etat = eta_out;
-	if (cosi > 0) { std::swap(etai, etat); }
-	// Compute sin using Snell's law
-	float sin = etai / etat * sqrtf(max(0.f, 1 - (double)cosi * cosi));
-	// Total internal reflection
-	if (sin >= 1) {
-		kr = 1;
-	}
-	else {
-		float cost = sqrtf(max(0.0f, 1.0f - (double)sin * sin));
-		cosi = fabsf(cosi);
-		float Rs = ((etai * cosi) - (etat * cost)) / ((etai * cosi) + (etat * cost));
-		float Rp = ((etai * cost) - (etat * cosi)) / ((etai * cost) + (etat * cosi));
-		kr = (Rs * Rs + Rp * Rp) / 2;
-	}
-	return kr;
-}
-
-Vector randomPointOnSphere(Sphere S) {
-	double randX = pow(-1.0, (rand() % 2 + 1)) * (rand() % 100);
-	double randY = pow(-1.0, (rand() % 2 + 1)) * (rand() % 100);
-	double randZ = pow(-1.0, (rand() % 2 + 1)) * (rand() % 100);
-	Vector randXYZ = Vector(randX, randY, randZ);
-	Vector randVector = (randXYZ - S.center).normalize();
-	Vector temp = randVector * S.radius;
-	Vector randPoint = S.center + temp;
-	return randPoint;
-}
-
-Vector pointOnSphere(Sphere S, int k) {
-	double randX = k;
-	double randY = k;
-	double randZ = k;
-	Vector randXYZ = Vector(randX, randY, randZ);
-	Vector randVector = (randXYZ - S.center).normalize();
-	Vector temp = randVector * S.radius;
-	Vector randPoint = S.center + temp;
-	return randPoint;
-}
-
-bool shadowRayTracing(Ray shadowRay) {
-	if (HASGRID) {
-		if (grid->TraverseShadow(shadowRay))
-			return true;
-		return false;
-	}
-	else {
-		int n = 0;
-		float t;
-		while (n < scene->getNumObjects()) {
-			if (scene->getObject(n)->intercepts(shadowRay, t)) {
-				return true;
-			}
-			n++;
-		}
-		return false;
-	}
-}
-
-Color calculateBlinnPhong(Vector lightPosition, Color lightColor, Vector  pointOnLight, Vector offset, Vector intersectionPoint, Vector normal, Vector rayDirection, Material* hitObjectMaterial) {
-	Color color;
-	Vector lightDirection = (lightPosition + pointOnLight - intersectionPoint).normalize();
-	Ray shadowRay = Ray(intersectionPoint + offset, lightDirection);
-	bool isShadow = shadowRayTracing(shadowRay);
-	float diffuse = lightDirection * normal;
-	if (diffuse > 0 && !isShadow) {
-		color += lightColor * diffuse * hitObjectMaterial->GetDiffuse() * hitObjectMaterial->GetDiffColor();
-
-		if (hitObjectMaterial->GetSpecular() > 0) {
-			float Hn = ((lightDirection - rayDirection).normalize()) * normal;
-			float specular = pow(max(0, Hn), hitObjectMaterial->GetShine());
-			color += lightColor * hitObjectMaterial->GetSpecular() * hitObjectMaterial->GetSpecColor() * specular;
-		}
-	}
-	return color;
-}
-
-Color rayTracing(Ray ray, int depth, float ior_1)  //index of refraction of medium 1 where the ray is travelling
-{
-	int n = 0;
-
-	float tNear = INFINITY;
-	float t;
-
-	Object* hitObject = nullptr;
-
-	Color color;
-
-	if (HASGRID) {
-		hitObject = grid->Traverse(ray, tNear);
-	}
-	else {
-		while (n < scene->getNumObjects()) {
-			if (scene->getObject(n)->intercepts(ray, t)) {
-				if (t < tNear) {
-					hitObject = scene->getObject(n);
-					tNear = t;
-				}
-			}
-			n++;
-		}
-	}
-
-	if (hitObject == nullptr) {
-		if (SKYBOX) {
-			scene->SetSkyBoxFlg(SKYBOX);
-			return scene->GetSkyboxColor(ray);
-		}
-		else
-			return scene->GetBackgroundColor();
-	}
-	else {
-		Material* hitObjectMaterial = hitObject->GetMaterial();
-
-		Vector intersectionPoint = ray.direction * tNear + ray.origin;
-		Vector normal = (hitObject->getNormal(intersectionPoint)).normalize();
-
-		n = 0;
-
-		Vector offset = normal * 0.001f;
-		bool inside = ray.direction * normal > 0;
-
-		while (n < scene->getNumLights()) {
-			Light* light = scene->getLight(n);
-			Vector pointOnLight = Vector(0, 0, 0);
-			if (ANTIALIASING) { //random method
-				if (SOFTSHADOWS) // gets random point within a sphere
-					pointOnLight = randomPointOnSphere(Sphere(light->position, 0.5));
-
-				color += calculateBlinnPhong(light->position, light->color, pointOnLight, offset, intersectionPoint, normal, ray.direction, hitObjectMaterial);
-			}
-			else {
-				if (SOFTSHADOWS)
-					// use area light with a set of SL_N light source points
-					for (int point = 0; point < SL_N; point++) {
-						// creates an area light (sphere)
-						pointOnLight = pointOnSphere(Sphere(light->position, 1), point);
-						color += calculateBlinnPhong(light->position, light->color, pointOnLight, offset, intersectionPoint, normal, ray.direction, hitObjectMaterial) * (1.0f / SL_N);
-					}
-				else
-					color += calculateBlinnPhong(light->position, light->color, pointOnLight, offset, intersectionPoint, normal, ray.direction, hitObjectMaterial);
-			}
-			n++;
-		}
-
-		if (depth >= MAX_DEPTH) return color;
-
-		//Calculates mirror reflection attenuation using fresnel equations
-		float kr = fresnel(ray.direction, normal, ior_1, hitObjectMaterial->GetRefrIndex());
-
-		//Object is reflective
-		if (hitObjectMaterial->GetReflection() > 0) {
-			Vector reflectedRayDirection = ray.direction - normal * (normal * ray.direction) * 2;
-			Ray reflectedRay = Ray(intersectionPoint + offset, reflectedRayDirection);
-			Color reflectedColor = rayTracing(reflectedRay, depth + 1, ior_1);
-			//Object is reflective and refracted -> use reflection attenuation (fresnel)
-			if (hitObjectMaterial->GetTransmittance() > 0) color += reflectedColor * kr;
-			else color += reflectedColor * hitObjectMaterial->GetSpecular() * hitObjectMaterial->GetSpecColor();
-		}
-
-		// Object is refracted
-		if (hitObjectMaterial->GetTransmittance() > 0) {
-			float eta_in = ior_1;
-			float eta_out = hitObjectMaterial->GetRefrIndex();
-
-			// Check if ray is inside object
-			if (inside) {
-				normal = normal * (-1);
-				eta_out = 1.0;
-			}
-
-			Vector direction = refract(ray.direction, normal, eta_in, eta_out);
-			Vector refractedRayOrigin;
-
-			if (inside) refractedRayOrigin = intersectionPoint + offset;
-			else refractedRayOrigin = intersectionPoint - offset;
-
-			Ray refractedRay = Ray(refractedRayOrigin, direction);
-			Color refractedColor = rayTracing(refractedRay, depth + 1, eta_out);
-			color += refractedColor * (1 - kr) * hitObjectMaterial->GetTransmittance();
-		}
-
-	}
-
-	return color;
-}
-
-/////////////////////////////////////////////////////////////////////// ERRORS
-
-bool isOpenGLError() {
-	bool isError = false;
-	GLenum errCode;
-	const GLubyte* errString;
-	while ((errCode = glGetError()) != GL_NO_ERROR) {
-		isError = true;
-		errString = gluErrorString(errCode);
-		std::cerr << "OpenGL ERROR [" << errString << "]." << std::endl;
-	}
-	return isError;
-}
-
-void checkOpenGLError(std::string error)
-{
-	if (isOpenGLError()) {
-		std::cerr << error << std::endl;
-		exit(EXIT_FAILURE);
-	}
-}
-
-/////////////////////////////////////////////////////////////////////// SHADERs
-
-const GLchar* VertexShader =
-{
-	"#version 430 core\n"
-
-	"in vec2 in_Position;\n"
-	"in vec3 in_Color;\n"
-	"uniform mat4 Matrix;\n"
-	"out vec4 color;\n"
-
-	"void main(void)\n"
-	"{\n"
-	"	vec4 position = vec4(in_Position, 0.0, 1.0);\n"
-	"	color = vec4(in_Color, 1.0);\n"
-	"	gl_Position = Matrix * position;\n"
-
-	"}\n"
-};
-
-const GLchar* FragmentShader =
-{
-	"#version 430 core\n"
-
-	"in vec4 color;\n"
-	"out vec4 out_Color;\n"
-
-	"void main(void)\n"
-	"{\n"
-	"	out_Color = color;\n"
-	"}\n"
-};
-
-void createShaderProgram()
-{
-	VertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(VertexShaderId, 1, &VertexShader, 0);
-	glCompileShader(VertexShaderId);
-
-	FragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(FragmentShaderId, 1, &FragmentShader, 0);
-	glCompileShader(FragmentShaderId);
-
-	ProgramId = glCreateProgram();
-	glAttachShader(ProgramId, VertexShaderId);
-	glAttachShader(ProgramId, FragmentShaderId);
-
-	glBindAttribLocation(ProgramId, VERTEX_COORD_ATTRIB, "in_Position");
-	glBindAttribLocation(ProgramId, COLOR_ATTRIB, "in_Color");
-
-	glLinkProgram(ProgramId);
-	UniformId = glGetUniformLocation(ProgramId, "Matrix");
-
-	checkOpenGLError("ERROR: Could not create shaders.");
-}
-
-void destroyShaderProgram()
-{
-	glUseProgram(0);
-	glDetachShader(ProgramId, VertexShaderId);
-	glDetachShader(ProgramId, FragmentShaderId);
-
-	glDeleteShader(FragmentShaderId);
-	glDeleteShader(VertexShaderId);
-	glDeleteProgram(ProgramId);
-
-	checkOpenGLError("ERROR: Could not destroy shaders.");
-}
-
-/////////////////////////////////////////////////////////////////////// VAOs & VBOs
-
-
-void createBufferObjects()
-{
-	glGenVertexArrays(1, &VaoId);
-	glBindVertexArray(VaoId);
-	glGenBuffers(2, VboId);
-	glBindBuffer(GL_ARRAY_BUFFER, VboId[0]);
-
-	/* Só se faz a alocação dos arrays glBufferData (NULL), e o envio dos pontos para a placa gráfica
-	é feito na drawPoints com GlBufferSubData em tempo de execução pois os arrays são GL_DYNAMIC_DRAW */
-	glBufferData(GL_ARRAY_BUFFER, size_vertices, NULL, GL_DYNAMIC_DRAW);
-	glEnableVertexAttribArray(VERTEX_COORD_ATTRIB);
-	glVertexAttribPointer(VERTEX_COORD_ATTRIB, 2, GL_FLOAT, 0, 0, 0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VboId[1]);
-	glBufferData(GL_ARRAY_BUFFER, size_colors, NULL, GL_DYNAMIC_DRAW);
-	glEnableVertexAttribArray(COLOR_ATTRIB);
-	glVertexAttribPointer(COLOR_ATTRIB, 3, GL_FLOAT, 0, 0, 0);
-
-	// unbind the VAO
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	//	glDisableVertexAttribArray(VERTEX_COORD_ATTRIB); 
-	//	glDisableVertexAttribArray(COLOR_ATTRIB);
-	checkOpenGLError("ERROR: Could not create VAOs and VBOs.");
-}
-
-void destroyBufferObjects()
-{
-	glDisableVertexAttribArray(VERTEX_COORD_ATTRIB);
-	glDisableVertexAttribArray(COLOR_ATTRIB);
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	glDeleteBuffers(1, VboId);
-	glDeleteVertexArrays(1, &VaoId);
-	checkOpenGLError("ERROR: Could not destroy VAOs and VBOs.");
-}
-
-void drawPoints()
-{
-	glBindVertexArray(VaoId);
-	glUseProgram(ProgramId);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VboId[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size_vertices, vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, VboId[1]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size_colors, colors);
-
-	glUniformMatrix4fv(UniformId, 1, GL_FALSE, m);
-
-	if (draw_mode == 0) glDrawArrays(GL_POINTS, 0, 1);
-	else if (draw_mode == 1) glDrawArrays(GL_POINTS, 0, RES_X);
-	else glDrawArrays(GL_POINTS, 0, RES_X * RES_Y);
-	glFinish();
-
-	glUseProgram(0);
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	checkOpenGLError("ERROR: Could not draw scene.");
-}
-
-ILuint saveImgFile(const char* filename) {
-	ILuint ImageId;
-
-	ilEnable(IL_FILE_OVERWRITE);
-	ilGenImages(1, &ImageId);
-	ilBindImage(ImageId);
-
-	ilTexImage(RES_X, RES_Y, 1, 3, IL_RGB, IL_UNSIGNED_BYTE, img_Data /*Texture*/);
-	ilSaveImage(filename);
-
-	ilDisable(IL_FILE_OVERWRITE);
-	ilDeleteImages(1, &ImageId);
-	if (ilGetError() != IL_NO_ERROR)return ilGetError();
-
-	return IL_NO_ERROR;
-}
-
-/////////////////////////////////////////////////////////////////////// CALLBACKS
-
-// Render function by primary ray casting from the eye towards the scene's objects
-
-void renderScene()
-{
-	cout << "\nANTIALIASING: " << ANTIALIASING << " DOF: " << DOF << " SOFTSHADOWS: " << SOFTSHADOWS << "\n";
-	cout << "\nPress 'a' to switch antialiasing on/off.\nPress 'd' to switch depth of field on/off.\nPress 's' to switch soft shadows on/off.\n" << std::endl;
-
-	int index_pos = 0;
-	int index_col = 0;
-	unsigned int counter = 0;
-
-	set_rand_seed(time(NULL) * time(NULL));
-
-	grid = new Grid(scene->getObjects());
-
-	for (int y = 0; y < RES_Y; y++)
-	{
-		for (int x = 0; x < RES_X; x++)
-		{
-			Color color;
-
-			Vector pixel;  //viewport coordinates
-			pixel.x = x + 0.5f;
-			pixel.y = y + 0.5f;
-
-
-			if (!ANTIALIASING) {
-				Ray ray = scene->GetCamera()->PrimaryRay(pixel);
-				color += rayTracing(ray, 1, 1.0).clamp();
-			}
-			else { // Has anti-aliasing
-				if (DOF) {
-					Vector ls = sample_unit_disk() * scene->GetCamera()->GetAperture();
-					for (int i = 0; i < SPP_N; i++) {
-						for (int j = 0; j < SPP_N; j++) {
-							Vector pixel_aux;
-							pixel_aux.x = x + (rand_float() + i) / (float)SPP_N;
-							pixel_aux.y = y + (rand_float() + j) / (float)SPP_N;
-							Ray dofRay = scene->GetCamera()->PrimaryRay(ls, pixel_aux);
-							color += rayTracing(dofRay, 1, 1.0).clamp();
-						}
-					}
-				}
-				else {
-					for (int i = 0; i < SPP_N; i++) {
-						for (int j = 0; j < SPP_N; j++) {
-							Vector pixel_aux;
-							pixel_aux.x = x + (rand_float() + i) / (float)SPP_N;
-							pixel_aux.y = y + (rand_float() + j) / (float)SPP_N;
-							Ray ray = scene->GetCamera()->PrimaryRay(pixel_aux);
-							color += rayTracing(ray, 1, 1.0).clamp();
-						}
-					}
-				}
-				color.r(color.r() / (float)pow(SPP_N, 2));
-				color.g(color.g() / (float)pow(SPP_N, 2));
-				color.b(color.b() / (float)pow(SPP_N, 2));
-			}
-
-			img_Data[counter++] = u8fromfloat((float)color.r());
-			img_Data[counter++] = u8fromfloat((float)color.g());
-			img_Data[counter++] = u8fromfloat((float)color.b());
-
-			if (drawModeEnabled) {
-				vertices[index_pos++] = (float)x;
-				vertices[index_pos++] = (float)y;
-				colors[index_col++] = (float)color.r();
-
-				colors[index_col++] = (float)color.g();
-
-				colors[index_col++] = (float)color.b();
-
-
-				if (draw_mode == 0) {  // drawing point by point
-					drawPoints();
-					index_pos = 0;
-					index_col = 0;
-				}
-			}
-		}
-		if (draw_mode == 1 && drawModeEnabled) {  // drawing line by line
-			drawPoints();
-			index_pos = 0;
-			index_col = 0;
-		}
-	}
-	if (draw_mode == 2 && drawModeEnabled)        //full frame at once
-		drawPoints();
-
-	printf("Drawing finished!\n");
-
-	if (saveImgFile("RT_Output.png") != IL_NO_ERROR) {
-		printf("Error saving Image file\n");
-		exit(0);
-	}
-	printf("Image file created\n");
-	glFlush();
-}
-
-// Callback function for glutCloseFunc
-void cleanup()
-{
-	destroyShaderProgram();
-	//destroyBufferObjects();
-}
-
-void ortho(float left, float right, float bottom, float top,
-	float nearp, float farp)
-{
-	m[0 * 4 + 0] = 2 / (right - left);
-	m[0 * 4 + 1] = 0.0;
-	m[0 * 4 + 2] = 0.0;
-	m[0 * 4 + 3] = 0.0;
-	m[1 * 4 + 0] = 0.0;
-	m[1 * 4 + 1] = 2 / (top - bottom);
-	m[1 * 4 + 2] = 0.0;
-	m[1 * 4 + 3] = 0.0;
-	m[2 * 4 + 0] = 0.0;
-	m[2 * 4 + 1] = 0.0;
-	m[2 * 4 + 2] = -2 / (farp - nearp);
-	m[2 * 4 + 3] = 0.0;
-	m[3 * 4 + 0] = -(right + left) / (right - left);
-	m[3 * 4 + 1] = -(top + bottom) / (top - bottom);
-	m[3 * 4 + 2] = -(farp + nearp) / (farp - nearp);
-	m[3 * 4 + 3] = 1.0;
-}
-
-void reshape(int w, int h)
-{
-	glClear(GL_COLOR_BUFFER_BIT);
-	glViewport(0, 0, w, h);
-	ortho(0, (float)RES_X, 0, (float)RES_Y, -1.0, 1.0);
-}
-
-void processKeys(unsigned char key, int xx, int yy)
-{
-	switch (key) {
-
-	case 27:
-		glutLeaveMainLoop();
-		break;
-
-	case 97: //a - switch antialiasing on/off
-		ANTIALIASING = !ANTIALIASING;
-		break;
-
-	case 100: //d - switch depth of field on/off
-		DOF = !DOF;
-		break;
-
-	case 115: //s - switch soft shadows on/off
-		SOFTSHADOWS = !SOFTSHADOWS;
-		break;
-
-	}
-	renderScene();
-}
-
-/////////////////////////////////////////////////////////////////////// SETUP
-
-void setupCallbacks()
-{
-	glutKeyboardFunc(processKeys);
-	glutCloseFunc(cleanup);
-	glutDisplayFunc(renderScene);
-	glutReshapeFunc(reshape);
-}
-
-void setupGLEW() {
-	glewExperimental = GL_TRUE;
-	GLenum result = glewInit();
-	if (result != GLEW_OK) {
-		std::cerr << "ERROR glewInit: " << glewGetString(result) << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	GLenum err_code = glGetError();
-	printf("Vendor: %s\n", glGetString(GL_VENDOR));
-	printf("Renderer: %s\n", glGetString(GL_RENDERER));
-	printf("Version: %s\n", glGetString(GL_VERSION));
-	printf("GLSL: %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
-}
-
-void setupGLUT(int argc, char* argv[])
-{
-	glutInit(&argc, argv);
-
-	glutInitContextVersion(4, 3);
-	glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
-	glutInitContextProfile(GLUT_CORE_PROFILE);
-
-	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
-
-	glutInitWindowPosition(640, 100);
-	glutInitWindowSize(RES_X, RES_Y);
-	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGBA);
-	glDisable(GL_DEPTH_TEST);
-	WindowHandle = glutCreateWindow(CAPTION);
-	if (WindowHandle < 1) {
-		std::cerr << "ERROR: Could not create a new rendering window." << std::endl;
-		exit(EXIT_FAILURE);
-	}
-}
-
-
-void init(int argc, char* argv[])
-{
-	setupGLUT(argc, argv);
-	setupGLEW();
-	std::cerr << "CONTEXT: OpenGL v" << glGetString(GL_VERSION) << std::endl;
-	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-	createShaderProgram();
-	createBufferObjects();
-	setupCallbacks();
-
-}
-
-
-void init_scene(void)
-{
-	char scenes_dir[70] = "P3D_Scenes/";
-	char input_user[50];
-	char scene_name[70];
-
-	while (true) {
-		cout << "Input the Scene Name: ";
-		cin >> input_user;
-		strcpy_s(scene_name, sizeof(scene_name), scenes_dir);
-		strcat_s(scene_name, sizeof(scene_name), input_user);
-
-		ifstream file(scene_name, ios::in);
-		if (file.fail()) {
-			printf("\nError opening P3F file.\n");
-		}
-		else
-			break;
-	}
-
-	scene = new Scene();
-	scene->load_p3f(scene_name);
-	RES_X = scene->GetCamera()->GetResX();
-	RES_Y = scene->GetCamera()->GetResY();
-	printf("\nResolutionX = %d  ResolutionY= %d.\n", RES_X, RES_Y);
-
-	// Pixel buffer to be used in the Save Image function
-	img_Data = (uint8_t*)malloc(3 * RES_X * RES_Y * sizeof(uint8_t));
-	if (img_Data == NULL) exit(1);
-}
-
-int main(int argc, char* argv[])
-{
-	//Initialization of DevIL 
-	if (ilGetInteger(IL_VERSION_NUM) < IL_VERSION)
-	{
-		printf("wrong DevIL version \n");
-		exit(0);
-	}
-	ilInit();
-
-	int ch;
-	if (!drawModeEnabled) {
-
-		do {
-			init_scene();
-			auto timeStart = std::chrono::high_resolution_clock::now();
-			renderScene();  //Just creating an image file
-			auto timeEnd = std::chrono::high_resolution_clock::now();
-			auto passedTime = std::chrono::duration<double, std::milli>(timeEnd - timeStart).count();
-			printf("\nDone: %.2f (sec)\n", passedTime / 1000);
-
-			cout << "\nPress 'y' to render another image or another key to terminate!\n";
-			delete(scene);
-			free(img_Data);
-			ch = _getch();
-		} while ((toupper(ch) == 'Y'));
-	}
-
-	else {   //Use OpenGL to draw image in the screen
-		init_scene();
-		if (draw_mode == 0) { // draw image point by point
-			size_vertices = 2 * sizeof(float);
-			size_colors = 3 * sizeof(float);
-			printf("DRAWING MODE: POINT BY POINT\n\n");
-		}
-		else if (draw_mode == 1) { // draw image line by line
-			size_vertices = 2 * RES_X * sizeof(float);
-			size_colors = 3 * RES_X * sizeof(float);
-			printf("DRAWING MODE: LINE BY LINE\n\n");
-		}
-		else if (draw_mode == 2) { // draw full frame at once
-			size_vertices = 2 * RES_X * RES_Y * sizeof(float);
-			size_colors = 3 * RES_X * RES_Y * sizeof(float);
-			printf("DRAWING MODE: FULL IMAGE\n\n");
-		}
-		else {
-			printf("Draw mode not valid \n");
-			exit(0);
-		}
-		vertices = (float*)malloc(size_vertices);
-		if (vertices == NULL) exit(1);
-
-		colors = (float*)malloc(size_colors);
-		if (colors == NULL) exit(1);
-
-		/* Setup GLUT and GLEW */
-		init(argc, argv);
-		glutMainLoop();
-	}
-
-	free(colors);
-	free(vertices);
-	printf("Program ended normally\n");
-	exit(EXIT_SUCCESS);
-}
+///////////////////////////////////////////////////////////////////////
+//
+// P3D Course
+// (c) 2019 by João Madeiras Pereira
+//Ray Tracing P3F scenes and drawing points with Modern OpenGL
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <chrono>
+#include <thread>
+#ifdef _WIN32
+#include <conio.h>
+#endif
+
+#ifndef HEADLESS
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#endif
+#ifndef NO_DEVIL
+#include <IL/il.h>
+#endif
+
+#include "scene.h"
+#include "grid.h"
+#include "bvh.h"
+#include "maths.h"
+#include "sampler.h"
+#include "threadPool.h"
+#include "stats.h"
+#include "rayKernels.h"
+
+#define CAPTION "Whitted Ray-Tracer"
+
+#define VERTEX_COORD_ATTRIB 0
+#define COLOR_ATTRIB 1
+
+#define MAX_DEPTH 4
+
+//antialiasing
+bool ANTIALIASING = false;
+int SPP_N = 4; //SPP_N x SPP_N jittered samples per pixel
+
+//Adaptive sampling: pixels get samples in batches of ADAPTIVE_MIN until the standard error of
+//their mean luminance drops below ADAPTIVE_THRESHOLD or SPP_N x SPP_N samples were taken
+bool ADAPTIVE = false;
+int ADAPTIVE_MIN = 4;
+float ADAPTIVE_THRESHOLD = 0.01f;
+
+//Progressive refinement: the image is rendered in passes of one more sample per pixel, accumulated in
+//accum_Data, until PROGRESSIVE_SPP samples per pixel or TIME_BUDGET ms (0: no limit) are reached.
+//The first pass is always completed, so there is a full image even if it takes longer than the budget.
+bool PROGRESSIVE = false;
+int PROGRESSIVE_SPP = 64;
+double TIME_BUDGET = 0.0;
+
+//Depth of Field
+bool DOF = false;
+
+//Soft shadows
+bool SOFTSHADOWS = false;
+int SL_N = 8; //N source points for Area Light
+
+//Skybox
+bool SKYBOX = false;
+
+//Sample points for the pixel, lens and area light dimensions, seeded from (pixel, sample, frame):
+//a render does not depend on the number of threads
+typedef enum { SAMPLER_JITTERED, SAMPLER_HALTON, SAMPLER_SOBOL, SAMPLER_BLUE } SamplerType;
+SamplerType SAMPLER = SAMPLER_JITTERED;
+const char* sampler_names[] = { "JITTERED", "HALTON", "SOBOL", "BLUE" };
+uint32_t frame = 0; //incremented after each render so that re-renders get new samples
+
+//Acceleration structure used to find ray/object hits
+typedef enum { ACCEL_NONE, ACCEL_GRID, ACCEL_BVH, ACCEL_GRID2 } AccelType;
+AccelType ACCEL = ACCEL_NONE;
+const char* accel_names[] = { "NONE", "GRID", "BVH", "GRID2" };
+
+//Packet tracing of the renders without antialiasing: the primary rays of blocks of PACKET_RAYS pixels, 4x4, 4x2
+//or 2x2, go through the acceleration structure together, and so do the shadow rays of their hits. 0: no packets
+int PACKET_RAYS = 16;
+
+//Grid resolution factor: 0 picks it with the grid's cost model
+float GRID_M = 0.0f;
+
+//Save the acceleration structures next to the scene file (scene.p3f.grid, .bvh or .grid2) and
+//load them from there in the next runs while the scene is unchanged
+bool ACCEL_CACHE = false;
+const char* accel_exts[] = { NULL, "grid", "bvh", "grid2" };
+
+//Multi-threaded rendering: the image is split in TILE_SIZE x TILE_SIZE tiles
+int NUM_THREADS = thread::hardware_concurrency();
+#define TILE_SIZE 32
+#define MIN_SPLIT_ROWS 2 //hot tiles are not split into pieces with less rows than this
+
+//Enable OpenGL drawing. The headless build and the batch mode never draw
+#ifdef HEADLESS
+bool drawModeEnabled = false;
+#else
+bool drawModeEnabled = true;
+#endif
+
+//Draw Mode: 0 - point by point; 1 - line by line; 2 - full frame at once
+int draw_mode = 1;
+
+// Points defined by 2 attributes: positions which are stored in vertices array and colors which are stored in colors array
+float* colors;
+float* vertices;
+int size_vertices;
+int size_colors;
+
+//Array of Pixels to be stored in a file by using DevIL library
+uint8_t* img_Data;
+
+//Number of samples taken by each pixel in the last render, in img_Data order
+vector<int> pixel_samples;
+
+//Sum of the samples of each pixel in progressive mode, 3 floats per pixel
+vector<float> accum_Data;
+int progressive_pass;
+chrono::high_resolution_clock::time_point render_deadline;
+
+//Image file written by renderScene, optional sample count heatmap and timings (ms) of the last render
+const char* output_file = "RT_Output.png";
+const char* heatmap_file = NULL;
+double build_time = 0.0, render_time = 0.0;
+
+#ifndef HEADLESS
+GLfloat m[16];  //projection matrix initialized by ortho function
+
+GLuint VaoId;
+GLuint VboId[2];
+
+GLuint VertexShaderId, FragmentShaderId, ProgramId;
+GLint UniformId;
+#endif
+
+Scene* scene = NULL;
+string scene_file;
+Accelerator* accel = NULL;
+Sampler* sampler = NULL;
+ThreadPool* pool = NULL;
+int RES_X, RES_Y;
+
+#ifndef HEADLESS
+int WindowHandle = 0;
+#endif
+
+Vector refract(Vector rayDirection, Vector normal, float eta_in, float eta_out) {
+	float eta = eta_in / eta_out;
+
+	Vector t, vt, direction;
+	float sin, cos;
+	Vector negDirection = rayDirection * (-1);
+	vt = normal * (negDirection * normal) - negDirection;
+	sin = eta * vt.length(); // sin = ||vt||
+
+	cos = sqrt(max(0.0f, 1.0f - (double)sin * sin));
+	t = vt / vt.length(); // t = (1/||vt||) * vt
+	direction = t * sin + (normal * (-1)) * cos;
+
+	return direction;
+}
+
+float fresnel(Vector rayDirection, Vector normal, float eta_in, float eta_out) {
+	float kr;
+	float cosi = clamp(-1, 1, rayDirection * normal);
+	float etai = 1, etat = eta_out;
+	if (cosi > 0) { std::swap(etai, etat); }
+	// Compute sin using Snell's law
+	float sin = etai / etat * sqrtf(max(0.f, 1 - (double)cosi * cosi));
+	// Total internal reflection
+	if (sin >= 1) {
+		kr = 1;
+	}
+	else {
+		float cost = sqrtf(max(0.0f, 1.0f - (double)sin * sin));
+		cosi = fabsf(cosi);
+		float Rs = ((etai * cosi) - (etat * cost)) / ((etai * cosi) + (etat * cost));
+		float Rp = ((etai * cost) - (etat * cosi)) / ((etai * cost) + (etat * cosi));
+		kr = (Rs * Rs + Rp * Rp) / 2;
+	}
+	return kr;
+}
+
+Vector pointOnSphere(Vector center, float radius, int k) {
+	double randX = k;
+	double randY = k;
+	double randZ = k;
+	Vector randXYZ = Vector(randX, randY, randZ);
+	Vector randVector = (randXYZ - center).normalize();
+	Vector temp = randVector * radius;
+	Vector randPoint = center + temp;
+	return randPoint;
+}
+
+// true if something lies between origin and the point at distance tmax along dir
+bool occluded(Vector origin, Vector dir, float tmax) {
+	RayStats::local().shadowRays++;
+	Ray shadowRay = Ray(origin, dir);
+
+	if (ACCEL != ACCEL_NONE)
+		return accel->Occluded(shadowRay, tmax);
+	else
+		return scene->Occluded(shadowRay, tmax);
+}
+
+// Closest hits of a packet of rays (hit[i] tells whether ray i hit something) and its shadow rays
+void packetTracing(Ray* rays, int count, HitRecord* hits, bool* hit) {
+	RayStats::local().rays += count;
+
+	if (ACCEL != ACCEL_NONE)
+		accel->TraversePacket(rays, count, hits, hit);
+	else
+		for (int i = 0; i < count; i++)
+			hit[i] = scene->Intersect(rays[i], hits[i]);
+}
+
+void shadowPacketTracing(Ray* rays, const float* tmax, int count, bool* occluded) {
+	RayStats::local().shadowRays += count;
+
+	if (ACCEL != ACCEL_NONE)
+		accel->OccludedPacket(rays, tmax, count, occluded);
+	else
+		for (int i = 0; i < count; i++)
+			occluded[i] = scene->Occluded(rays[i], tmax[i]);
+}
+
+Color missColor(Ray& ray) {
+	if (SKYBOX && scene->GetSkyBoxFlg())
+		return scene->GetSkyboxColor(ray);
+	else
+		return scene->GetBackgroundColor();
+}
+
+// Number of points sampled on each light: an area light of SL_N points for soft shadows without
+// antialiasing, a random point per sample with it
+int numLightPoints() {
+	return !ANTIALIASING && SOFTSHADOWS ? SL_N : 1;
+}
+
+Vector lightPoint(Light* light, int point, PixelSample& ps) {
+	if (!SOFTSHADOWS) return Vector(0, 0, 0);
+
+	if (ANTIALIASING) { //random method: gets random point on a sphere of radius 0.5 around the light
+		float u, v;
+		sampler->Get2D(ps, u, v);
+		return sample_unit_sphere(u, v) * 0.5f;
+	}
+	// creates an area light (sphere): the offset of its point from the light, as above
+	return pointOnSphere(light->position, 1, point) - light->position;
+}
+
+// Unit vector from the hit to a point on the light, whose distance goes to distance
+Vector lightDirection(Light* light, Vector pointOnLight, HitRecord& hit, float& distance) {
+	Vector toLight = light->position + pointOnLight - hit.point;
+	distance = toLight.length();
+	return toLight.normalize();
+}
+
+Color calculateBlinnPhong(Color lightColor, Vector lightDirection, bool isShadow, HitRecord& hit, Vector rayDirection) {
+	Color color;
+	Material* hitObjectMaterial = hit.material;
+	float diffuse = lightDirection * hit.normal;
+	if (diffuse > 0 && !isShadow) {
+		color += lightColor * diffuse * hitObjectMaterial->GetDiffuse() * hitObjectMaterial->GetDiffColor();
+
+		if (hitObjectMaterial->GetSpecular() > 0) {
+			float Hn = ((lightDirection - rayDirection).normalize()) * hit.normal;
+			float specular = pow(max(0, Hn), hitObjectMaterial->GetShine());
+			color += lightColor * hitObjectMaterial->GetSpecular() * hitObjectMaterial->GetSpecColor() * specular;
+		}
+	}
+	return color;
+}
+
+Color rayTracing(Ray ray, int depth, float ior_1, PixelSample& ps);
+
+// Adds the reflected and refracted light of a hit to its color
+void secondaryRayTracing(Ray& ray, HitRecord& hit, int depth, float ior_1, PixelSample& ps, Color& color) {
+	if (depth >= MAX_DEPTH) return;
+
+	Material* hitObjectMaterial = hit.material;
+	Vector normal = hit.normal;
+	Vector offset = normal * 0.001f;
+	bool inside = ray.direction * normal > 0;
+
+	//Calculates mirror reflection attenuation using fresnel equations
+	float kr = fresnel(ray.direction, normal, ior_1, hitObjectMaterial->GetRefrIndex());
+
+	//Object is reflective
+	if (hitObjectMaterial->GetReflection() > 0) {
+		Vector reflectedRayDirection = ray.direction - normal * (normal * ray.direction) * 2;
+		Ray reflectedRay = Ray(hit.point + offset, reflectedRayDirection);
+		Color reflectedColor = rayTracing(reflectedRay, depth + 1, ior_1, ps);
+		//Object is reflective and refracted -> use reflection attenuation (fresnel)
+		if (hitObjectMaterial->GetTransmittance() > 0) color += reflectedColor * kr;
+		else color += reflectedColor * hitObjectMaterial->GetSpecular() * hitObjectMaterial->GetSpecColor();
+	}
+
+	// Object is refracted
+	if (hitObjectMaterial->GetTransmittance() > 0) {
+		float eta_in = ior_1;
+		float eta_out = hitObjectMaterial->GetRefrIndex();
+
+		// Check if ray is inside object
+		if (inside) {
+			normal = normal * (-1);
+			eta_out = 1.0;
+		}
+
+		Vector direction = refract(ray.direction, normal, eta_in, eta_out);
+		Vector refractedRayOrigin;
+
+		if (inside) refractedRayOrigin = hit.point + offset;
+		else refractedRayOrigin = hit.point - offset;
+
+		Ray refractedRay = Ray(refractedRayOrigin, direction);
+		Color refractedColor = rayTracing(refractedRay, depth + 1, eta_out, ps);
+		color += refractedColor * (1 - kr) * hitObjectMaterial->GetTransmittance();
+	}
+}
+
+Color rayTracing(Ray ray, int depth, float ior_1, PixelSample& ps)  //index of refraction of medium 1 where the ray is travelling
+{
+	bool hitObject = false;
+	HitRecord hit;
+
+	Color color;
+
+	RayStats::local().rays++;
+
+	if (ACCEL != ACCEL_NONE) {
+		hitObject = accel->Traverse(ray, hit);
+	}
+	else {
+		hitObject = scene->Intersect(ray, hit);
+	}
+
+	if (!hitObject) return missColor(ray);
+
+	Vector offset = hit.normal * 0.001f;
+
+	for (int n = 0; n < scene->getNumLights(); n++) {
+		Light* light = scene->getLight(n);
+		for (int point = 0; point < numLightPoints(); point++) {
+			float distance;
+			Vector L = lightDirection(light, lightPoint(light, point, ps), hit, distance);
+			bool isShadow = occluded(hit.point + offset, L, distance);
+			color += calculateBlinnPhong(light->color, L, isShadow, hit, ray.direction) * (1.0f / numLightPoints());
+		}
+	}
+
+	secondaryRayTracing(ray, hit, depth, ior_1, ps, color);
+	return color;
+}
+
+#ifndef HEADLESS
+/////////////////////////////////////////////////////////////////////// ERRORS
+
+bool isOpenGLError() {
+	bool isError = false;
+	GLenum errCode;
+	const GLubyte* errString;
+	while ((errCode = glGetError()) != GL_NO_ERROR) {
+		isError = true;
+		errString = gluErrorString(errCode);
+		std::cerr << "OpenGL ERROR [" << errString << "]." << std::endl;
+	}
+	return isError;
+}
+
+void checkOpenGLError(std::string error)
+{
+	if (isOpenGLError()) {
+		std::cerr << error << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////// SHADERs
+
+const GLchar* VertexShader =
+{
+	"#version 430 core\n"
+
+	"in vec2 in_Position;\n"
+	"in vec3 in_Color;\n"
+	"uniform mat4 Matrix;\n"
+	"out vec4 color;\n"
+
+	"void main(void)\n"
+	"{\n"
+	"	vec4 position = vec4(in_Position, 0.0, 1.0);\n"
+	"	color = vec4(in_Color, 1.0);\n"
+	"	gl_Position = Matrix * position;\n"
+
+	"}\n"
+};
+
+const GLchar* FragmentShader =
+{
+	"#version 430 core\n"
+
+	"in vec4 color;\n"
+	"out vec4 out_Color;\n"
+
+	"void main(void)\n"
+	"{\n"
+	"	out_Color = color;\n"
+	"}\n"
+};
+
+void createShaderProgram()
+{
+	VertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(VertexShaderId, 1, &VertexShader, 0);
+	glCompileShader(VertexShaderId);
+
+	FragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(FragmentShaderId, 1, &FragmentShader, 0);
+	glCompileShader(FragmentShaderId);
+
+	ProgramId = glCreateProgram();
+	glAttachShader(ProgramId, VertexShaderId);
+	glAttachShader(ProgramId, FragmentShaderId);
+
+	glBindAttribLocation(ProgramId, VERTEX_COORD_ATTRIB, "in_Position");
+	glBindAttribLocation(ProgramId, COLOR_ATTRIB, "in_Color");
+
+	glLinkProgram(ProgramId);
+	UniformId = glGetUniformLocation(ProgramId, "Matrix");
+
+	checkOpenGLError("ERROR: Could not create shaders.");
+}
+
+void destroyShaderProgram()
+{
+	glUseProgram(0);
+	glDetachShader(ProgramId, VertexShaderId);
+	glDetachShader(ProgramId, FragmentShaderId);
+
+	glDeleteShader(FragmentShaderId);
+	glDeleteShader(VertexShaderId);
+	glDeleteProgram(ProgramId);
+
+	checkOpenGLError("ERROR: Could not destroy shaders.");
+}
+
+/////////////////////////////////////////////////////////////////////// VAOs & VBOs
+
+
+void createBufferObjects()
+{
+	glGenVertexArrays(1, &VaoId);
+	glBindVertexArray(VaoId);
+	glGenBuffers(2, VboId);
+	glBindBuffer(GL_ARRAY_BUFFER, VboId[0]);
+
+	/* Só se faz a alocação dos arrays glBufferData (NULL), e o envio dos pontos para a placa gráfica
+	é feito na drawPoints com GlBufferSubData em tempo de execução pois os arrays são GL_DYNAMIC_DRAW */
+	glBufferData(GL_ARRAY_BUFFER, size_vertices, NULL, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(VERTEX_COORD_ATTRIB);
+	glVertexAttribPointer(VERTEX_COORD_ATTRIB, 2, GL_FLOAT, 0, 0, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VboId[1]);
+	glBufferData(GL_ARRAY_BUFFER, size_colors, NULL, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(COLOR_ATTRIB);
+	glVertexAttribPointer(COLOR_ATTRIB, 3, GL_FLOAT, 0, 0, 0);
+
+	// unbind the VAO
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//	glDisableVertexAttribArray(VERTEX_COORD_ATTRIB); 
+	//	glDisableVertexAttribArray(COLOR_ATTRIB);
+	checkOpenGLError("ERROR: Could not create VAOs and VBOs.");
+}
+
+void destroyBufferObjects()
+{
+	glDisableVertexAttribArray(VERTEX_COORD_ATTRIB);
+	glDisableVertexAttribArray(COLOR_ATTRIB);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	glDeleteBuffers(1, VboId);
+	glDeleteVertexArrays(1, &VaoId);
+	checkOpenGLError("ERROR: Could not destroy VAOs and VBOs.");
+}
+
+void drawPoints()
+{
+	glBindVertexArray(VaoId);
+	glUseProgram(ProgramId);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VboId[0]);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size_vertices, vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, VboId[1]);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size_colors, colors);
+
+	glUniformMatrix4fv(UniformId, 1, GL_FALSE, m);
+
+	if (draw_mode == 0) glDrawArrays(GL_POINTS, 0, 1);
+	else if (draw_mode == 1) glDrawArrays(GL_POINTS, 0, RES_X);
+	else glDrawArrays(GL_POINTS, 0, RES_X * RES_Y);
+	glFinish();
+
+	glUseProgram(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	checkOpenGLError("ERROR: Could not draw scene.");
+}
+
+#endif
+
+// Binary PPM writer: needs no image library, so headless nodes without DevIL can save images
+bool savePPM(const char* filename, const uint8_t* rgb) {
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", RES_X, RES_Y);
+	for (int y = RES_Y - 1; y >= 0; y--)   // img_Data starts at the bottom row, PPM at the top one
+		fwrite(rgb + 3 * y * RES_X, 1, 3 * RES_X, file);
+
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
+
+// Reads a binary PPM of the current resolution into rgb, in img_Data order
+bool loadPPM(const char* filename, vector<uint8_t>& rgb) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) return false;
+
+	int width, height, maxval;
+	bool ok = fscanf(file, "P6 %d %d %d", &width, &height, &maxval) == 3 && fgetc(file) != EOF &&
+		width == RES_X && height == RES_Y && maxval == 255;
+
+	rgb.resize(3 * RES_X * RES_Y);
+	for (int y = RES_Y - 1; ok && y >= 0; y--)
+		ok = fread(&rgb[3 * y * RES_X], 1, 3 * RES_X, file) == (size_t)(3 * RES_X);
+
+	fclose(file);
+	return ok;
+}
+
+// Root mean square error of the rendered image against a reference, on the [0, 1] scale
+double imageRMSE(const vector<uint8_t>& reference) {
+	double sum = 0.0;
+	for (int i = 0; i < 3 * RES_X * RES_Y; i++) {
+		double d = (img_Data[i] - reference[i]) / 255.0;
+		sum += d * d;
+	}
+	return sqrt(sum / (3.0 * RES_X * RES_Y));
+}
+
+// Most samples a pixel can take in the current mode
+int maxPixelSamples()
+{
+	if (PROGRESSIVE) return PROGRESSIVE_SPP;
+	return ANTIALIASING ? SPP_N * SPP_N : 1;
+}
+
+double averageSamples() {
+	double sum = 0.0;
+	for (int i = 0; i < RES_X * RES_Y; i++)
+		sum += pixel_samples[i];
+	return sum / (RES_X * RES_Y);
+}
+
+// Sample counts as a .ppm: blue for pixels that stopped after the first batch, red for the ones that took every sample
+bool saveHeatmap(const char* filename) {
+	int maxSamples = maxPixelSamples();
+	int minSamples = ADAPTIVE && !PROGRESSIVE ? MIN(ADAPTIVE_MIN, maxSamples) : maxSamples;
+	if (PROGRESSIVE) minSamples = 1;
+	vector<uint8_t> rgb(3 * RES_X * RES_Y);
+
+	for (int i = 0; i < RES_X * RES_Y; i++) {
+		float t = maxSamples > minSamples ? (float)(pixel_samples[i] - minSamples) / (maxSamples - minSamples) : 1.0f;
+		rgb[3 * i] = u8fromfloat(t);
+		rgb[3 * i + 1] = u8fromfloat(1.0f - fabsf(2.0f * t - 1.0f));
+		rgb[3 * i + 2] = u8fromfloat(1.0f - t);
+	}
+	return savePPM(filename, &rgb[0]);
+}
+
+bool saveImgFile(const char* filename) {
+	const char* ext = strrchr(filename, '.');
+	if (ext != NULL && strcmp(ext, ".ppm") == 0)
+		return savePPM(filename, img_Data);
+
+#ifdef NO_DEVIL
+	printf("Built without DevIL: only .ppm images can be saved\n");
+	return false;
+#else
+	ILuint ImageId;
+
+	ilEnable(IL_FILE_OVERWRITE);
+	ilGenImages(1, &ImageId);
+	ilBindImage(ImageId);
+
+	ilTexImage(RES_X, RES_Y, 1, 3, IL_RGB, IL_UNSIGNED_BYTE, img_Data /*Texture*/);
+	ilSaveImage(filename);
+
+	ilDisable(IL_FILE_OVERWRITE);
+	ilDeleteImages(1, &ImageId);
+
+	return ilGetError() == IL_NO_ERROR;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////// CALLBACKS
+
+// Traces sample i of pixel (x, y), with antialiasing
+
+Color renderSample(int x, int y, int i)
+{
+	PixelSample ps(x, y, i, frame);
+	float u, v;
+
+	sampler->Get2D(ps, u, v);
+	Vector pixel_aux;
+	pixel_aux.x = x + u;
+	pixel_aux.y = y + v;
+	if (DOF) {
+		sampler->Get2D(ps, u, v);
+		Vector ls = sample_unit_disk(u, v) * scene->GetCamera()->GetAperture();
+		Ray dofRay = scene->GetCamera()->PrimaryRay(ls, pixel_aux);
+		return rayTracing(dofRay, 1, 1.0, ps).clamp();
+	}
+	else {
+		ps.dim = DIM_LENS + 1;   // keep the light dimensions the same with and without DOF
+		Ray ray = scene->GetCamera()->PrimaryRay(pixel_aux);
+		return rayTracing(ray, 1, 1.0, ps).clamp();
+	}
+}
+
+// Computes the color of pixel (x, y) by primary ray casting from the eye towards the scene's objects.
+// samples returns the number of primary rays used.
+
+Color renderPixel(int x, int y, int& samples)
+{
+	Color color;
+
+	Vector pixel;  //viewport coordinates
+	pixel.x = x + 0.5f;
+	pixel.y = y + 0.5f;
+
+
+	if (!ANTIALIASING) {
+		PixelSample ps(x, y, 0, frame);
+		Ray ray = scene->GetCamera()->PrimaryRay(pixel);
+		color += rayTracing(ray, 1, 1.0, ps).clamp();
+		samples = 1;
+	}
+	else if (!ADAPTIVE) { // Has anti-aliasing
+		for (int i = 0; i < SPP_N * SPP_N; i++)
+			color += renderSample(x, y, i);
+		samples = SPP_N * SPP_N;
+	}
+	else { // Adaptive anti-aliasing
+		int maxSamples = SPP_N * SPP_N;
+		int minSamples = MIN(ADAPTIVE_MIN, maxSamples);
+		double mean = 0.0, m2 = 0.0;   // Welford's running mean and sum of squared deviations of the luminance
+		int n = 0;
+
+		while (n < maxSamples) {
+			Color sample = renderSample(x, y, n);
+			color += sample;
+			n++;
+
+			double lum = 0.2126 * sample.r() + 0.7152 * sample.g() + 0.0722 * sample.b();
+			double delta = lum - mean;
+			mean += delta / n;
+			m2 += delta * (lum - mean);
+
+			// the estimate is only tested at the end of each batch: a few equal samples prove nothing
+			if (n % minSamples == 0 && n > 1 && sqrt(m2 / ((n - 1) * (double)n)) <= ADAPTIVE_THRESHOLD)
+				break;
+		}
+		samples = n;
+	}
+
+	color.r(color.r() / samples);
+	color.g(color.g() / samples);
+	color.b(color.b() / samples);
+
+	return color;
+}
+
+// Progressive mode: adds one sample to pixel (x, y) and stores the new average in img_Data
+
+void refinePixel(int x, int y)
+{
+	int i = y * RES_X + x;
+	Color color = renderSample(x, y, pixel_samples[i]);
+	int n = ++pixel_samples[i];
+
+	accum_Data[3 * i] += color.r();
+	accum_Data[3 * i + 1] += color.g();
+	accum_Data[3 * i + 2] += color.b();
+
+	img_Data[3 * i] = u8fromfloat(accum_Data[3 * i] / n);
+	img_Data[3 * i + 1] = u8fromfloat(accum_Data[3 * i + 1] / n);
+	img_Data[3 * i + 2] = u8fromfloat(accum_Data[3 * i + 2] / n);
+}
+
+// Renders the pixels [x0, x1[ x [y0, y1[ of a packet, without antialiasing, as renderPixel() would:
+// the primary rays are traced together, then the shadow rays of their hits for each light point,
+// and then each ray goes on alone with its reflections and refractions.
+
+void renderPacket(int x0, int y0, int x1, int y1)
+{
+	Ray rays[PACKET_SIZE], shadowRays[PACKET_SIZE];
+	float distance[PACKET_SIZE];
+	HitRecord hits[PACKET_SIZE];
+	bool hit[PACKET_SIZE], occluded[PACKET_SIZE];
+	Color color[PACKET_SIZE];
+	int lanes[PACKET_SIZE];
+	int count = 0;
+
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			Vector pixel = Vector(x + 0.5f, y + 0.5f, 0.0f);
+			rays[count++] = scene->GetCamera()->PrimaryRay(pixel);
+		}
+	}
+	packetTracing(rays, count, hits, hit);
+
+	for (int n = 0; n < scene->getNumLights(); n++) {
+		Light* light = scene->getLight(n);
+		for (int point = 0; point < numLightPoints(); point++) {
+			int numShadowRays = 0;
+			for (int i = 0; i < count; i++) {
+				if (!hit[i]) continue;
+				PixelSample ps(x0 + i % (x1 - x0), y0 + i / (x1 - x0), 0, frame);
+				Vector L = lightDirection(light, lightPoint(light, point, ps), hits[i], distance[numShadowRays]);
+				shadowRays[numShadowRays] = Ray(hits[i].point + hits[i].normal * 0.001f, L);
+				lanes[numShadowRays++] = i;
+			}
+			shadowPacketTracing(shadowRays, distance, numShadowRays, occluded);
+
+			for (int j = 0; j < numShadowRays; j++) {
+				int i = lanes[j];
+				color[i] += calculateBlinnPhong(light->color, shadowRays[j].direction, occluded[j], hits[i], rays[i].direction) * (1.0f / numLightPoints());
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		int x = x0 + i % (x1 - x0), y = y0 + i / (x1 - x0);
+		PixelSample ps(x, y, 0, frame);
+
+		if (hit[i]) secondaryRayTracing(rays[i], hits[i], 1, 1.0, ps, color[i]);
+		else color[i] = missColor(rays[i]);
+		color[i] = color[i].clamp();
+		pixel_samples[y * RES_X + x] = 1;
+
+		int counter = 3 * (y * RES_X + x);
+		img_Data[counter++] = u8fromfloat((float)color[i].r());
+		img_Data[counter++] = u8fromfloat((float)color[i].g());
+		img_Data[counter++] = u8fromfloat((float)color[i].b());
+	}
+}
+
+// Renders the pixels [x0, x1[ x [y0, y1[ straight into img_Data.
+// Tiles never overlap, so the workers write their pixels without locking.
+// Tiles showing deep reflections/refractions take much longer than background ones: when a
+// worker runs out of work, the rows still left in the current tile are split in half and
+// the bottom half is queued so the idle worker can steal it.
+
+void renderTile(int x0, int y0, int x1, int y1)
+{
+	bool packets = PACKET_RAYS > 0 && !ANTIALIASING;
+	int packet_w = PACKET_RAYS >= 8 ? 4 : 2;
+	int packet_h = PACKET_RAYS / packet_w;
+
+	for (int y = y0, rows = 1; y < y1; y += rows)
+	{
+		if (PROGRESSIVE) {
+			// out of time: the rows not done keep the average of the previous passes
+			if (progressive_pass > 0 && TIME_BUDGET > 0.0 && chrono::high_resolution_clock::now() >= render_deadline)
+				return;
+			for (int x = x0; x < x1; x++)
+				refinePixel(x, y);
+		}
+		else if (packets) {
+			rows = MIN(packet_h, y1 - y);
+			for (int x = x0; x < x1; x += packet_w)
+				renderPacket(x, y, MIN(x + packet_w, x1), y + rows);
+		}
+		else {
+			for (int x = x0; x < x1; x++)
+			{
+				int samples;
+				Color color = renderPixel(x, y, samples);
+				pixel_samples[y * RES_X + x] = samples;
+
+				int counter = 3 * (y * RES_X + x);
+				img_Data[counter++] = u8fromfloat((float)color.r());
+				img_Data[counter++] = u8fromfloat((float)color.g());
+				img_Data[counter++] = u8fromfloat((float)color.b());
+			}
+		}
+
+		int rows_left = y1 - (y + rows);
+		if (rows_left >= 2 * MIN_SPLIT_ROWS && pool->needsWork()) {
+			int mid = y + rows + rows_left / 2;
+			int end = y1;
+			pool->addTask([=] { renderTile(x0, mid, x1, end); });
+			y1 = mid;
+		}
+	}
+}
+
+// Splits the image into tiles which are traced by the thread pool, and waits for them
+
+void renderTiles()
+{
+	for (int y0 = 0; y0 < RES_Y; y0 += TILE_SIZE) {
+		for (int x0 = 0; x0 < RES_X; x0 += TILE_SIZE) {
+			int x1 = MIN(x0 + TILE_SIZE, RES_X);
+			int y1 = MIN(y0 + TILE_SIZE, RES_Y);
+			pool->addTask([=] { renderTile(x0, y0, x1, y1); });
+		}
+	}
+	pool->wait();
+}
+
+// Render function: builds the acceleration structure and the sampler, then renders the image
+
+void renderScene()
+{
+	cout << "\nANTIALIASING: " << ANTIALIASING << " DOF: " << DOF << " SOFTSHADOWS: " << SOFTSHADOWS << " ACCELERATION: " << accel_names[ACCEL] << " SAMPLER: " << sampler_names[SAMPLER] << "\n";
+	if (drawModeEnabled)
+		cout << "\nPress 'a' to switch antialiasing on/off.\nPress 'd' to switch depth of field on/off.\nPress 's' to switch soft shadows on/off.\nPress 'g' to cycle the acceleration structure (none/grid/BVH/two-level grid).\n" << std::endl;
+
+	if (pool == NULL) pool = new ThreadPool(NUM_THREADS);
+
+	// the scene keeps the structures it was rendered with: they are built once per loaded scene
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	accel = scene->getAccelerator(ACCEL);
+	build_time = 0.0;
+	if (accel != NULL)
+		printf("%s of the scene reused\n", accel_names[ACCEL]);
+	else if (ACCEL != ACCEL_NONE) {
+		if (ACCEL == ACCEL_GRID)
+			accel = new Grid(scene, pool, GRID_M);
+		else if (ACCEL == ACCEL_BVH)
+			accel = new BVH(scene, pool);
+		else
+			accel = new Grid(scene, pool, GRID_M, 2);
+
+		string cache_file = scene_file + "." + accel_exts[ACCEL];
+		bool loaded = ACCEL_CACHE && accel->Load(cache_file.c_str());
+		if (!loaded) {
+			accel->Build();
+			if (ACCEL_CACHE && !accel->Save(cache_file.c_str()))
+				fprintf(stderr, "Could not save the acceleration structure to %s.\n", cache_file.c_str());
+		}
+		scene->setAccelerator(ACCEL, accel);
+
+		auto buildEnd = std::chrono::high_resolution_clock::now();
+		build_time = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+		if (loaded)
+			printf("%s loaded from %s in %.2f ms\n", accel_names[ACCEL], cache_file.c_str(), build_time);
+		else
+			printf("%s built in %.2f ms with %d threads\n", accel_names[ACCEL], build_time, pool->getNumThreads());
+	}
+
+	delete sampler;
+	if (SAMPLER == SAMPLER_HALTON)
+		sampler = new HaltonSampler(maxPixelSamples());
+	else if (SAMPLER == SAMPLER_SOBOL)
+		sampler = new SobolSampler(maxPixelSamples());
+	else if (SAMPLER == SAMPLER_BLUE)
+		sampler = new BlueNoiseSampler(maxPixelSamples());
+	else
+		sampler = new JitteredSampler(maxPixelSamples());
+
+	pool->resetTimes();
+	RayStats::reset();
+	pixel_samples.assign(RES_X * RES_Y, 0);
+
+	auto timeStart = std::chrono::high_resolution_clock::now();
+
+	if (PROGRESSIVE) {
+		accum_Data.assign(3 * RES_X * RES_Y, 0.0f);
+		render_deadline = timeStart + chrono::microseconds((long long)(TIME_BUDGET * 1000.0));
+
+		for (progressive_pass = 0; progressive_pass < PROGRESSIVE_SPP; progressive_pass++) {
+			renderTiles();
+			if (TIME_BUDGET > 0.0 && chrono::high_resolution_clock::now() >= render_deadline) {
+				progressive_pass++;
+				break;
+			}
+		}
+	}
+	else
+		renderTiles();
+	frame++;
+
+	auto timeEnd = std::chrono::high_resolution_clock::now();
+	render_time = std::chrono::duration<double, std::milli>(timeEnd - timeStart).count();
+	pool->printTimes(render_time);
+
+	RayStats stats = RayStats::total();
+	printf("Rays: %llu + %llu shadow rays, %.2f Mrays/s\n", (unsigned long long)stats.rays, (unsigned long long)stats.shadowRays,
+		(stats.rays + stats.shadowRays) / (render_time * 1000.0));
+	if (ACCEL != ACCEL_NONE) {
+		printf("Object tests: %llu, repeated grid tests skipped by the mailbox: %llu\n",
+			(unsigned long long)stats.objectTests, (unsigned long long)stats.mailboxSkips);
+		if (ACCEL != ACCEL_BVH && stats.rays > 0)
+			printf("Per ray: %.2f cells visited\n", stats.cells / (double)stats.rays);
+		if (stats.shadowRays > 0)
+			printf("Per shadow ray: %.2f %s visited, %.2f object tests\n", stats.shadowCells / (double)stats.shadowRays,
+				ACCEL == ACCEL_BVH ? "nodes" : "cells", stats.shadowTests / (double)stats.shadowRays);
+	}
+	if (PROGRESSIVE)
+		printf("Progressive rendering: %d passes, %.2f samples per pixel on average, at most %d\n", progressive_pass, averageSamples(), PROGRESSIVE_SPP);
+	else if (ANTIALIASING && ADAPTIVE)
+		printf("Adaptive sampling: %.2f samples per pixel on average, at most %d\n", averageSamples(), SPP_N * SPP_N);
+
+#ifndef HEADLESS
+	// OpenGL is only called from this thread, once every tile is done
+	if (drawModeEnabled) {
+		int index_pos = 0;
+		int index_col = 0;
+		unsigned int counter = 0;
+
+		for (int y = 0; y < RES_Y; y++)
+		{
+			for (int x = 0; x < RES_X; x++)
+			{
+				vertices[index_pos++] = (float)x;
+				vertices[index_pos++] = (float)y;
+				colors[index_col++] = u8tofloat(img_Data[counter++]);
+
+				colors[index_col++] = u8tofloat(img_Data[counter++]);
+
+				colors[index_col++] = u8tofloat(img_Data[counter++]);
+
+
+				if (draw_mode == 0) {  // drawing point by point
+					drawPoints();
+					index_pos = 0;
+					index_col = 0;
+				}
+			}
+			if (draw_mode == 1) {  // drawing line by line
+				drawPoints();
+				index_pos = 0;
+				index_col = 0;
+			}
+		}
+		if (draw_mode == 2)        //full frame at once
+			drawPoints();
+	}
+#endif
+
+	printf("Drawing finished!\n");
+
+	if (!saveImgFile(output_file)) {
+		printf("Error saving Image file\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("Image file created\n");
+
+	if (heatmap_file != NULL) {
+		if (!saveHeatmap(heatmap_file)) {
+			printf("Error saving the sample count heatmap\n");
+			exit(EXIT_FAILURE);
+		}
+		printf("Sample count heatmap saved to %s\n", heatmap_file);
+	}
+#ifndef HEADLESS
+	if (drawModeEnabled) glFlush();
+#endif
+}
+
+#ifndef HEADLESS
+// Callback function for glutCloseFunc
+void cleanup()
+{
+	destroyShaderProgram();
+	//destroyBufferObjects();
+}
+
+void ortho(float left, float right, float bottom, float top,
+	float nearp, float farp)
+{
+	m[0 * 4 + 0] = 2 / (right - left);
+	m[0 * 4 + 1] = 0.0;
+	m[0 * 4 + 2] = 0.0;
+	m[0 * 4 + 3] = 0.0;
+	m[1 * 4 + 0] = 0.0;
+	m[1 * 4 + 1] = 2 / (top - bottom);
+	m[1 * 4 + 2] = 0.0;
+	m[1 * 4 + 3] = 0.0;
+	m[2 * 4 + 0] = 0.0;
+	m[2 * 4 + 1] = 0.0;
+	m[2 * 4 + 2] = -2 / (farp - nearp);
+	m[2 * 4 + 3] = 0.0;
+	m[3 * 4 + 0] = -(right + left) / (right - left);
+	m[3 * 4 + 1] = -(top + bottom) / (top - bottom);
+	m[3 * 4 + 2] = -(farp + nearp) / (farp - nearp);
+	m[3 * 4 + 3] = 1.0;
+}
+
+void reshape(int w, int h)
+{
+	glClear(GL_COLOR_BUFFER_BIT);
+	glViewport(0, 0, w, h);
+	ortho(0, (float)RES_X, 0, (float)RES_Y, -1.0, 1.0);
+}
+
+void processKeys(unsigned char key, int xx, int yy)
+{
+	switch (key) {
+
+	case 27:
+		glutLeaveMainLoop();
+		break;
+
+	case 97: //a - switch antialiasing on/off
+		ANTIALIASING = !ANTIALIASING;
+		break;
+
+	case 100: //d - switch depth of field on/off
+		DOF = !DOF;
+		break;
+
+	case 115: //s - switch soft shadows on/off
+		SOFTSHADOWS = !SOFTSHADOWS;
+		break;
+
+	case 103: //g - cycle acceleration structure none -> grid -> BVH -> two-level grid
+		ACCEL = (AccelType)((ACCEL + 1) % 4);
+		break;
+
+	}
+	renderScene();
+}
+
+/////////////////////////////////////////////////////////////////////// SETUP
+
+void setupCallbacks()
+{
+	glutKeyboardFunc(processKeys);
+	glutCloseFunc(cleanup);
+	glutDisplayFunc(renderScene);
+	glutReshapeFunc(reshape);
+}
+
+void setupGLEW() {
+	glewExperimental = GL_TRUE;
+	GLenum result = glewInit();
+	if (result != GLEW_OK) {
+		std::cerr << "ERROR glewInit: " << glewGetString(result) << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	GLenum err_code = glGetError();
+	printf("Vendor: %s\n", glGetString(GL_VENDOR));
+	printf("Renderer: %s\n", glGetString(GL_RENDERER));
+	printf("Version: %s\n", glGetString(GL_VERSION));
+	printf("GLSL: %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+}
+
+void setupGLUT(int argc, char* argv[])
+{
+	glutInit(&argc, argv);
+
+	glutInitContextVersion(4, 3);
+	glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
+	glutInitContextProfile(GLUT_CORE_PROFILE);
+
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+
+	glutInitWindowPosition(640, 100);
+	glutInitWindowSize(RES_X, RES_Y);
+	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGBA);
+	glDisable(GL_DEPTH_TEST);
+	WindowHandle = glutCreateWindow(CAPTION);
+	if (WindowHandle < 1) {
+		std::cerr << "ERROR: Could not create a new rendering window." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+void init(int argc, char* argv[])
+{
+	setupGLUT(argc, argv);
+	setupGLEW();
+	std::cerr << "CONTEXT: OpenGL v" << glGetString(GL_VERSION) << std::endl;
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	createShaderProgram();
+	createBufferObjects();
+	setupCallbacks();
+
+}
+#endif
+
+
+// Loads a P3F scene and allocates the pixel buffer for its resolution
+bool load_scene(const char* scene_name)
+{
+	ifstream file(scene_name, ios::in);
+	if (file.fail())
+		return false;
+	file.close();
+
+	scene = new Scene();
+	bool loaded = is_p3b(scene_name) ? scene->load_p3b(scene_name) : scene->load_p3f(scene_name);
+	if (!loaded || scene->GetCamera() == NULL) {
+		delete scene;
+		scene = NULL;
+		return false;
+	}
+	scene_file = scene_name;
+	RES_X = scene->GetCamera()->GetResX();
+	RES_Y = scene->GetCamera()->GetResY();
+	printf("\nResolutionX = %d  ResolutionY= %d.\n", RES_X, RES_Y);
+
+	// Pixel buffer to be used in the Save Image function
+	img_Data = (uint8_t*)malloc(3 * RES_X * RES_Y * sizeof(uint8_t));
+	if (img_Data == NULL) exit(1);
+	return true;
+}
+
+void init_scene(void)
+{
+	char scenes_dir[70] = "P3D_Scenes/";
+	char input_user[50];
+	char scene_name[120];
+
+	while (true) {
+		cout << "Input the Scene Name: ";
+		if (!(cin >> setw(sizeof(input_user)) >> input_user))
+			exit(EXIT_FAILURE);
+		snprintf(scene_name, sizeof(scene_name), "%s%s", scenes_dir, input_user);
+
+		if (load_scene(scene_name))
+			break;
+		printf("\nError opening P3F file.\n");
+	}
+}
+
+/////////////////////////////////////////////////////////////////////// BATCH MODE
+
+void printUsage(const char* program)
+{
+	printf("Usage: %s --scene <file.p3f|file.p3b> --output <image> [options]\n", program);
+	printf("       %s --scene <file.p3f> --convert <file.p3b>\n\n", program);
+	printf("  --convert <file>     save the scene in the binary .p3b format instead of rendering it\n");
+	printf("  --aa <n>             antialiasing with n x n jittered samples per pixel\n");
+	printf("  --soft-shadows <n>   soft shadows with n samples per area light\n");
+	printf("  --dof                depth of field (needs --aa)\n");
+	printf("  --skybox             use the scene's skybox as background\n");
+	printf("  --threads <n>        number of render threads (default: all cores)\n");
+	printf("  --accel <type>       none, grid, bvh or grid2, a two-level grid (default: grid)\n");
+	printf("  --sampler <type>     jittered, halton, sobol or blue (default: jittered)\n");
+	printf("  --kernel <type>      intersection loops: scalar, sse or avx2 (default: the widest\n");
+	printf("                       one the CPU supports)\n");
+	printf("  --packet <n>         rays traced together without --aa: 0 (none), 4, 8 or 16 (default)\n");
+	printf("  --grid-m <m>         grid cells per object factor (default: chosen by a cost model)\n");
+	printf("  --accel-cache        load the acceleration structure from <scene>.grid, .bvh or .grid2\n");
+	printf("                       when it was saved for the same scene, else build and save it\n");
+	printf("  --reference <file>   .ppm of the same scene to report the RMSE against\n");
+	printf("  --adaptive <error>   with --aa: stop sampling a pixel once the standard error of its\n");
+	printf("                       luminance is below error (e.g. 0.01); --aa n gives the cap\n");
+	printf("  --adaptive-min <n>   samples per batch of adaptive sampling (default: 4)\n");
+	printf("  --heatmap <file>     also save the number of samples per pixel as a .ppm\n");
+	printf("  --progressive <n>    render in passes of one sample per pixel, up to n samples\n");
+	printf("  --time-budget <ms>   progressive rendering (up to 4096 samples unless --progressive\n");
+	printf("                       is given) that stops after the pass running when ms have passed\n\n");
+	printf("Images are saved as .ppm, or in any format DevIL supports when it is available.\n");
+	printf("Ends with a line \"RESULT key=value ...\" holding the timings in ms.\n");
+}
+
+// Non-interactive render for headless render nodes: everything comes from the command
+// line, no OpenGL context is created and the exit code tells whether the image was saved.
+int batchRender(int argc, char* argv[])
+{
+	const char* scene_name = NULL;
+	const char* reference_file = NULL;
+	const char* convert_file = NULL;
+	output_file = NULL;
+	ACCEL = ACCEL_GRID;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		bool usedValue = true;
+
+		if (!strcmp(arg, "--scene") && value) scene_name = value;
+		else if (!strcmp(arg, "--output") && value) output_file = value;
+		else if (!strcmp(arg, "--aa") && value) { SPP_N = atoi(value); ANTIALIASING = true; }
+		else if (!strcmp(arg, "--soft-shadows") && value) { SL_N = atoi(value); SOFTSHADOWS = true; }
+		else if (!strcmp(arg, "--threads") && value) NUM_THREADS = atoi(value);
+		else if (!strcmp(arg, "--accel") && value) {
+			if (!strcmp(value, "none")) ACCEL = ACCEL_NONE;
+			else if (!strcmp(value, "grid")) ACCEL = ACCEL_GRID;
+			else if (!strcmp(value, "bvh")) ACCEL = ACCEL_BVH;
+			else if (!strcmp(value, "grid2")) ACCEL = ACCEL_GRID2;
+			else { fprintf(stderr, "Unknown acceleration structure '%s'.\n", value); return EXIT_FAILURE; }
+		}
+		else if (!strcmp(arg, "--sampler") && value) {
+			if (!strcmp(value, "jittered")) SAMPLER = SAMPLER_JITTERED;
+			else if (!strcmp(value, "halton")) SAMPLER = SAMPLER_HALTON;
+			else if (!strcmp(value, "sobol")) SAMPLER = SAMPLER_SOBOL;
+			else if (!strcmp(value, "blue")) SAMPLER = SAMPLER_BLUE;
+			else { fprintf(stderr, "Unknown sampler '%s'.\n", value); return EXIT_FAILURE; }
+		}
+		else if (!strcmp(arg, "--kernel") && value) {
+			int k = KERNEL_SCALAR;
+			while (k <= KERNEL_AVX2 && strcmp(value, kernel_names[k])) k++;
+			if (k > KERNEL_AVX2) { fprintf(stderr, "Unknown kernel '%s'.\n", value); return EXIT_FAILURE; }
+			if (!setKernel((KernelType)k)) { fprintf(stderr, "This CPU can not run the %s kernel.\n", value); return EXIT_FAILURE; }
+		}
+		else if (!strcmp(arg, "--packet") && value) {
+			PACKET_RAYS = atoi(value);
+			if (PACKET_RAYS != 0 && PACKET_RAYS != 4 && PACKET_RAYS != 8 && PACKET_RAYS != 16) {
+				fprintf(stderr, "Packets hold 4, 8 or 16 rays.\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(arg, "--grid-m") && value) GRID_M = atof(value);
+		else if (!strcmp(arg, "--reference") && value) reference_file = value;
+		else if (!strcmp(arg, "--convert") && value) convert_file = value;
+		else if (!strcmp(arg, "--adaptive") && value) { ADAPTIVE_THRESHOLD = atof(value); ADAPTIVE = true; }
+		else if (!strcmp(arg, "--adaptive-min") && value) ADAPTIVE_MIN = atoi(value);
+		else if (!strcmp(arg, "--heatmap") && value) heatmap_file = value;
+		else if (!strcmp(arg, "--progressive") && value) { PROGRESSIVE_SPP = atoi(value); PROGRESSIVE = true; }
+		else if (!strcmp(arg, "--time-budget") && value) {
+			TIME_BUDGET = atof(value);
+			if (!PROGRESSIVE) PROGRESSIVE_SPP = 4096;
+			PROGRESSIVE = true;
+		}
+		else {
+			usedValue = false;
+			if (!strcmp(arg, "--dof")) DOF = true;
+			else if (!strcmp(arg, "--skybox")) SKYBOX = true;
+			else if (!strcmp(arg, "--accel-cache")) ACCEL_CACHE = true;
+			else {
+				if (strcmp(arg, "--help")) fprintf(stderr, "Invalid argument '%s'.\n", arg);
+				printUsage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+		if (usedValue) i++;
+	}
+
+	if (scene_name != NULL && convert_file != NULL) {
+		auto convertStart = std::chrono::high_resolution_clock::now();
+		SceneDesc desc;
+		if (!parse_p3f(scene_name, desc)) {
+			fprintf(stderr, "Error opening P3F file %s.\n", scene_name);
+			return EXIT_FAILURE;
+		}
+		if (!save_p3b(convert_file, desc)) {
+			fprintf(stderr, "Error writing %s.\n", convert_file);
+			return EXIT_FAILURE;
+		}
+		auto convertEnd = std::chrono::high_resolution_clock::now();
+		printf("RESULT scene=%s converted=%s objects=%u triangles=%u vertices=%u convert_ms=%.2f\n", scene_name, convert_file,
+			desc.header.numObjects, desc.header.numTriangles, desc.header.numVertices,
+			std::chrono::duration<double, std::milli>(convertEnd - convertStart).count());
+		return EXIT_SUCCESS;
+	}
+
+	if (scene_name == NULL || output_file == NULL || SPP_N < 1 || SL_N < 1 || NUM_THREADS < 1 || ADAPTIVE_MIN < 1 || ADAPTIVE_THRESHOLD < 0 ||
+		PROGRESSIVE_SPP < 1 || TIME_BUDGET < 0) {
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (PROGRESSIVE && ADAPTIVE) {
+		fprintf(stderr, "--adaptive can not be combined with progressive rendering.\n");
+		return EXIT_FAILURE;
+	}
+	if (PROGRESSIVE) ANTIALIASING = true;   // every pass jitters the samples
+
+#ifdef NO_DEVIL
+	const char* ext = strrchr(output_file, '.');
+	if (ext == NULL || strcmp(ext, ".ppm")) {
+		fprintf(stderr, "Built without DevIL: the output image must be a .ppm file.\n");
+		return EXIT_FAILURE;
+	}
+#endif
+
+	drawModeEnabled = false;
+
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	if (!load_scene(scene_name)) {
+		fprintf(stderr, "Error opening P3F file %s.\n", scene_name);
+		return EXIT_FAILURE;
+	}
+	auto loadEnd = std::chrono::high_resolution_clock::now();
+	double load_time = std::chrono::duration<double, std::milli>(loadEnd - loadStart).count();
+
+	vector<uint8_t> reference;
+	if (reference_file != NULL && !loadPPM(reference_file, reference)) {
+		fprintf(stderr, "Could not read the reference image %s: it must be a %dx%d binary .ppm.\n", reference_file, RES_X, RES_Y);
+		return EXIT_FAILURE;
+	}
+
+	renderScene();
+
+	RayStats stats = RayStats::total();
+	printf("RESULT scene=%s output=%s width=%d height=%d threads=%d accel=%s kernel=%s packet=%d aa=%d soft_shadows=%d dof=%d sampler=%s "
+		"spp=%.2f load_ms=%.2f build_ms=%.2f render_ms=%.2f total_ms=%.2f rays=%llu shadow_rays=%llu",
+		scene_name, output_file, RES_X, RES_Y, NUM_THREADS, accel_names[ACCEL], kernel_names[getKernel()],
+		ANTIALIASING ? 0 : PACKET_RAYS, maxPixelSamples(), SOFTSHADOWS ? SL_N : 0, DOF ? 1 : 0, sampler_names[SAMPLER], averageSamples(),
+		load_time, build_time, render_time, load_time + build_time + render_time,
+		(unsigned long long)stats.rays, (unsigned long long)stats.shadowRays);
+	if (reference_file != NULL)
+		printf(" rmse=%.6f", imageRMSE(reference));
+	printf("\n");
+	fflush(stdout);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+#ifndef NO_DEVIL
+	//Initialization of DevIL 
+	if (ilGetInteger(IL_VERSION_NUM) < IL_VERSION)
+	{
+		printf("wrong DevIL version \n");
+		exit(0);
+	}
+	ilInit();
+#endif
+
+	if (argc > 1)
+		exit(batchRender(argc, argv));
+
+#ifdef HEADLESS
+	printUsage(argv[0]);
+	exit(EXIT_FAILURE);
+#else
+	int ch;
+	if (!drawModeEnabled) {
+
+		do {
+			init_scene();
+			auto timeStart = std::chrono::high_resolution_clock::now();
+			renderScene();  //Just creating an image file
+			auto timeEnd = std::chrono::high_resolution_clock::now();
+			auto passedTime = std::chrono::duration<double, std::milli>(timeEnd - timeStart).count();
+			printf("\nDone: %.2f (sec)\n", passedTime / 1000);
+
+			cout << "\nPress 'y' to render another image or another key to terminate!\n";
+			delete(scene);
+			free(img_Data);
+#ifdef _WIN32
+			ch = _getch();
+#else
+			char answer = 'n';
+			cin >> answer;
+			ch = answer;
+#endif
+		} while ((toupper(ch) == 'Y'));
+	}
+
+	else {   //Use OpenGL to draw image in the screen
+		init_scene();
+		if (draw_mode == 0) { // draw image point by point
+			size_vertices = 2 * sizeof(float);
+			size_colors = 3 * sizeof(float);
+			printf("DRAWING MODE: POINT BY POINT\n\n");
+		}
+		else if (draw_mode == 1) { // draw image line by line
+			size_vertices = 2 * RES_X * sizeof(float);
+			size_colors = 3 * RES_X * sizeof(float);
+			printf("DRAWING MODE: LINE BY LINE\n\n");
+		}
+		else if (draw_mode == 2) { // draw full frame at once
+			size_vertices = 2 * RES_X * RES_Y * sizeof(float);
+			size_colors = 3 * RES_X * RES_Y * sizeof(float);
+			printf("DRAWING MODE: FULL IMAGE\n\n");
+		}
+		else {
+			printf("Draw mode not valid \n");
+			exit(0);
+		}
+		vertices = (float*)malloc(size_vertices);
+		if (vertices == NULL) exit(1);
+
+		colors = (float*)malloc(size_colors);
+		if (colors == NULL) exit(1);
+
+		/* Setup GLUT and GLEW */
+		init(argc, argv);
+		glutMainLoop();
+	}
+
+	free(colors);
+	free(vertices);
+	printf("Program ended normally\n");
+	exit(EXIT_SUCCESS);
+#endif
+}
 ///////////////////////////////////////////////////////////////////////
\ No newline at end of file
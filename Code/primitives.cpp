@@ -0,0 +1,297 @@
+#include <iostream>
+
+#include "primitives.h"
+#include "scene.h"
+#include "rayKernels.h"
+
+// The intersection tests keep the arithmetic of the scene's former Triangle, Sphere, aaBox and
+// Plane classes, so the images did not change with the storage and the dispatch. The triangle
+// and sphere loops are in rayKernels.cpp.
+
+/////////////////////////////////////////////////////////////////////// Triangle meshes
+
+size_t TriangleMesh::getMemoryUsage()
+{
+	return 3 * vx.size() * sizeof(float) + indices.size() * sizeof(uint32_t);
+}
+
+uint32_t TriangleMesh::addVertex(const Vector& v)
+{
+	vx.push_back(v.x);
+	vy.push_back(v.y);
+	vz.push_back(v.z);
+	return vx.size() - 1;
+}
+
+void TriangleMesh::addTriangle(uint32_t v0, uint32_t v1, uint32_t v2)
+{
+	indices.push_back(v0);
+	indices.push_back(v1);
+	indices.push_back(v2);
+}
+
+int TriangleMesh::Closest(const PrimRef* refs, int count, Ray& r, float& t)
+{
+	TriangleArrays mesh = { vx.data(), vy.data(), vz.data(), indices.data() };
+	return closestTriangle(mesh, refs, count, r, t);
+}
+
+bool TriangleMesh::Any(const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	TriangleArrays mesh = { vx.data(), vy.data(), vz.data(), indices.data() };
+	return anyTriangle(mesh, refs, count, r, tmax);
+}
+
+Vector TriangleMesh::getNormal(uint32_t prim)
+{
+	const uint32_t* idx = &indices[3 * prim];
+	Vector edge1 = Vector(vx[idx[1]] - vx[idx[0]], vy[idx[1]] - vy[idx[0]], vz[idx[1]] - vz[idx[0]]);
+	Vector edge2 = Vector(vx[idx[2]] - vx[idx[0]], vy[idx[2]] - vy[idx[0]], vz[idx[2]] - vz[idx[0]]);
+	return (edge1 % edge2).normalize();
+}
+
+// beta and gamma of the hit of the ray with the triangle, as the intersection kernels compute them
+void TriangleMesh::getBarycentrics(uint32_t prim, Ray& r, float& u, float& v)
+{
+	const uint32_t* idx = &indices[3 * prim];
+	float a = vx[idx[0]] - vx[idx[1]], b = vx[idx[0]] - vx[idx[2]], c = r.direction.x, d = vx[idx[0]] - r.origin.x;
+	float e = vy[idx[0]] - vy[idx[1]], f = vy[idx[0]] - vy[idx[2]], g = r.direction.y, h = vy[idx[0]] - r.origin.y;
+	float i = vz[idx[0]] - vz[idx[1]], j = vz[idx[0]] - vz[idx[2]], k = r.direction.z, l = vz[idx[0]] - r.origin.z;
+
+	float m = f * k - g * j, n = h * k - g * l, p = f * l - h * j;
+	float q = g * i - e * k, s = e * j - f * i;
+
+	float inv_denom = 1.0f / (a * m + b * q + c * s);
+
+	u = (d * m - b * n - c * p) * inv_denom;
+	v = (a * n + d * q + c * (e * l - h * i)) * inv_denom;
+}
+
+AABB TriangleMesh::GetBoundingBox(uint32_t prim)
+{
+	const uint32_t* idx = &indices[3 * prim];
+	Vector min = Vector(FLT_MAX, FLT_MAX, FLT_MAX), max = Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	for (int i = 0; i < 3; i++) {
+		Vector p = Vector(vx[idx[i]], vy[idx[i]], vz[idx[i]]);
+		if (p.x < min.x) min.x = p.x;
+		if (p.x > max.x) max.x = p.x;
+		if (p.y < min.y) min.y = p.y;
+		if (p.y > max.y) max.y = p.y;
+		if (p.z < min.z) min.z = p.z;
+		if (p.z > max.z) max.z = p.z;
+	}
+
+	// enlarge the bounding box a bit just in case...
+	min -= EPSILON;
+	max += EPSILON;
+	return AABB(min, max);
+}
+
+/////////////////////////////////////////////////////////////////////// Spheres
+
+void SphereSet::add(const Vector& center, float a_radius, Material* m)
+{
+	records.push_back(center.x);
+	records.push_back(center.y);
+	records.push_back(center.z);
+	records.push_back(a_radius * a_radius);
+	radius.push_back(a_radius);
+	material.push_back(m);
+}
+
+int SphereSet::Closest(const PrimRef* refs, int count, Ray& r, float& t)
+{
+	SphereArrays spheres = { records.data() };
+	return closestSphere(spheres, refs, count, r, t);
+}
+
+bool SphereSet::Any(const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	SphereArrays spheres = { records.data() };
+	return anySphere(spheres, refs, count, r, tmax);
+}
+
+Vector SphereSet::getNormal(uint32_t prim, Vector point)
+{
+	const float* c = &records[4 * prim];
+	Vector normal = point - Vector(c[0], c[1], c[2]);
+	return normal.normalize();
+}
+
+AABB SphereSet::GetBoundingBox(uint32_t prim)
+{
+	const float* c = &records[4 * prim];
+	float rad = radius[prim];
+	return AABB(Vector(c[0] - rad, c[1] - rad, c[2] - rad), Vector(c[0] + rad, c[1] + rad, c[2] + rad));
+}
+
+/////////////////////////////////////////////////////////////////////// Boxes
+
+void BoxSet::add(const Vector& min, const Vector& max, Material* m)
+{
+	minX.push_back(min.x); minY.push_back(min.y); minZ.push_back(min.z);
+	maxX.push_back(max.x); maxY.push_back(max.y); maxZ.push_back(max.z);
+	material.push_back(m);
+}
+
+// Slab test with the reciprocals of the ray direction, computed once per run
+struct BoxRay {
+	float ox, oy, oz;
+	double a;
+	float b, c;
+
+	BoxRay(Ray& ray) : ox(ray.origin.x), oy(ray.origin.y), oz(ray.origin.z),
+		a(1.0 / ray.direction.x), b(1.0 / ray.direction.y), c(1.0 / ray.direction.z) {}
+};
+
+static inline bool boxHit(const BoxRay& br, float x0, float y0, float z0, float x1, float y1, float z1, float& t)
+{
+	float tx_min, ty_min, tz_min;
+	float tx_max, ty_max, tz_max;
+
+	if (br.a >= 0) {
+		tx_min = (x0 - br.ox) * br.a;
+		tx_max = (x1 - br.ox) * br.a;
+	}
+	else {
+		tx_min = (x1 - br.ox) * br.a;
+		tx_max = (x0 - br.ox) * br.a;
+	}
+
+	if (br.b >= 0) {
+		ty_min = (y0 - br.oy) * br.b;
+		ty_max = (y1 - br.oy) * br.b;
+	}
+	else {
+		ty_min = (y1 - br.oy) * br.b;
+		ty_max = (y0 - br.oy) * br.b;
+	}
+
+	if (br.c >= 0) {
+		tz_min = (z0 - br.oz) * br.c;
+		tz_max = (z1 - br.oz) * br.c;
+	}
+	else {
+		tz_min = (z1 - br.oz) * br.c;
+		tz_max = (z0 - br.oz) * br.c;
+	}
+
+	// largest entering and smallest exiting t values
+	float t0 = tx_min > ty_min ? tx_min : ty_min;
+	if (tz_min > t0) t0 = tz_min;
+
+	float t1 = tx_max < ty_max ? tx_max : ty_max;
+	if (tz_max < t1) t1 = tz_max;
+
+	t = t0 > 0 ? t0 : t1;
+	return t0 < t1 && t1 >= EPSILON;
+}
+
+int BoxSet::Closest(const PrimRef* refs, int count, Ray& r, float& t)
+{
+	BoxRay br(r);
+	int hit = -1;
+	float tn;
+
+	for (int n = 0; n < count; n++) {
+		uint32_t i = refs[n].prim;
+		if (boxHit(br, minX[i], minY[i], minZ[i], maxX[i], maxY[i], maxZ[i], tn) && tn < t) {
+			t = tn;
+			hit = n;
+		}
+	}
+	return hit;
+}
+
+bool BoxSet::Any(const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	BoxRay br(r);
+	float tn;
+
+	for (int n = 0; n < count; n++) {
+		uint32_t i = refs[n].prim;
+		if (boxHit(br, minX[i], minY[i], minZ[i], maxX[i], maxY[i], maxZ[i], tn) && tn < tmax) return true;
+	}
+	return false;
+}
+
+// The hit face is recovered from the hit point: the nearest face
+Vector BoxSet::getNormal(uint32_t prim, Vector point)
+{
+	float dist[6] = { fabs(point.x - minX[prim]), fabs(point.x - maxX[prim]),
+					  fabs(point.y - minY[prim]), fabs(point.y - maxY[prim]),
+					  fabs(point.z - minZ[prim]), fabs(point.z - maxZ[prim]) };
+	Vector faces[6] = { Vector(-1, 0, 0), Vector(1, 0, 0),
+						Vector(0, -1, 0), Vector(0, 1, 0),
+						Vector(0, 0, -1), Vector(0, 0, 1) };
+	int face = 0;
+	for (int i = 1; i < 6; i++)
+		if (dist[i] < dist[face]) face = i;
+
+	return faces[face];
+}
+
+AABB BoxSet::GetBoundingBox(uint32_t prim)
+{
+	return AABB(Vector(minX[prim], minY[prim], minZ[prim]), Vector(maxX[prim], maxY[prim], maxZ[prim]));
+}
+
+/////////////////////////////////////////////////////////////////////// Planes
+
+void PlaneSet::add(Vector& P0, Vector& P1, Vector& P2, Material* m)
+{
+	//Calculate the normal plane: counter-clockwise vectorial product.
+	Vector edge1 = P1 - P0;
+	Vector edge2 = P2 - P0;
+	Vector PN = (edge1 % edge2).normalize();
+	float D = 0.0f;
+
+	if (PN.length() == 0.0)
+		cerr << "DEGENERATED PLANE!\n";
+	else {
+		PN.normalize();
+		D = P0 * PN;
+	}
+
+	nx.push_back(PN.x); ny.push_back(PN.y); nz.push_back(PN.z);
+	d.push_back(D);
+	material.push_back(m);
+}
+
+static inline bool planeHit(float nx, float ny, float nz, float d, Ray& r, float& t)
+{
+	float aux = nx * r.direction.x + ny * r.direction.y + nz * r.direction.z;
+
+	//There is no intersection
+	if (abs(aux) < 0.0001f) return false;
+
+	t = -((r.origin.x * nx + r.origin.y * ny + r.origin.z * nz) - d) / aux;
+	return t > 0.0f;
+}
+
+int PlaneSet::Closest(const PrimRef* refs, int count, Ray& r, float& t)
+{
+	int hit = -1;
+	float tn;
+
+	for (int n = 0; n < count; n++) {
+		uint32_t i = refs[n].prim;
+		if (planeHit(nx[i], ny[i], nz[i], d[i], r, tn) && tn < t) {
+			t = tn;
+			hit = n;
+		}
+	}
+	return hit;
+}
+
+bool PlaneSet::Any(const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	float tn;
+
+	for (int n = 0; n < count; n++) {
+		uint32_t i = refs[n].prim;
+		if (planeHit(nx[i], ny[i], nz[i], d[i], r, tn) && tn < tmax) return true;
+	}
+	return false;
+}
@@ -0,0 +1,129 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <vector>
+#include <stdint.h>
+using namespace std;
+
+#include "vector.h"
+#include "ray.h"
+#include "boundingBox.h"
+
+class Material;
+
+// Geometry stored by type as structures of arrays. The acceleration structures keep their
+// references sorted by set, so that a cell or a leaf is intersected with one call per run of
+// primitives of the same set, in a loop with no virtual call per primitive.
+
+// Reference to one primitive of the scene: prim of the triangle mesh set, or of the sphere,
+// box or plane arrays when set is PRIM_SPHERES, PRIM_BOXES or PRIM_PLANES
+#define PRIM_SPHERES 0xfffffffdu
+#define PRIM_BOXES   0xfffffffeu
+#define PRIM_PLANES  0xffffffffu
+
+struct PrimRef {
+	uint32_t set;
+	uint32_t prim;
+};
+
+inline bool operator<(const PrimRef& a, const PrimRef& b)
+{
+	return a.set < b.set;
+}
+
+// A ray/primitive hit with everything the shading needs. The intersection loops only find the t
+// and prim of the closest hit; the rest is filled in once for that hit by Scene::CompleteHit().
+struct HitRecord {
+	float t;            // distance along the ray
+	Vector point;
+	Vector normal;      // unit normal
+	PrimRef prim;
+	float u, v;         // barycentric coordinates (beta, gamma) on a triangle, 0 on the other primitives
+	Material* material;
+};
+
+// The intersection of a run: Closest() returns the position in refs of the closest hit nearer
+// than t and updates t, or -1; Any() returns true when some primitive is hit nearer than tmax.
+
+// Triangles sharing one material: a pool of welded vertices and a 32-bit index triple per triangle.
+class TriangleMesh
+{
+public:
+	TriangleMesh(Material* a_Mat) : material(a_Mat) {}
+
+	int getNumTriangles() { return indices.size() / 3; }
+	int getNumVertices() { return vx.size(); }
+	Material* GetMaterial() { return material; }
+	size_t getMemoryUsage();
+
+	uint32_t addVertex(const Vector& v);
+	void addTriangle(uint32_t v0, uint32_t v1, uint32_t v2);
+
+	int Closest(const PrimRef* refs, int count, Ray& r, float& t);
+	bool Any(const PrimRef* refs, int count, Ray& r, float tmax);
+	Vector getNormal(uint32_t prim);
+	void getBarycentrics(uint32_t prim, Ray& r, float& u, float& v);
+	AABB GetBoundingBox(uint32_t prim);
+
+private:
+	vector<float> vx, vy, vz;
+	vector<uint32_t> indices;
+	Material* material;
+};
+
+// Spheres, stored as 16 byte records of center and squared radius: the kernels intersect
+// spheres picked by the references in any order, which takes one load per sphere this way
+class SphereSet
+{
+public:
+	void add(const Vector& center, float radius, Material* m);
+	int size() { return radius.size(); }
+	Material* GetMaterial(uint32_t prim) { return material[prim]; }
+
+	int Closest(const PrimRef* refs, int count, Ray& r, float& t);
+	bool Any(const PrimRef* refs, int count, Ray& r, float tmax);
+	Vector getNormal(uint32_t prim, Vector point);
+	AABB GetBoundingBox(uint32_t prim);
+
+private:
+	vector<float> records;   // center x, y, z and radius² of each sphere
+	vector<float> radius;
+	vector<Material*> material;
+};
+
+// Axis aligned boxes
+class BoxSet
+{
+public:
+	void add(const Vector& min, const Vector& max, Material* m);
+	int size() { return material.size(); }
+	Material* GetMaterial(uint32_t prim) { return material[prim]; }
+
+	int Closest(const PrimRef* refs, int count, Ray& r, float& t);
+	bool Any(const PrimRef* refs, int count, Ray& r, float tmax);
+	Vector getNormal(uint32_t prim, Vector point);
+	AABB GetBoundingBox(uint32_t prim);
+
+private:
+	vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	vector<Material*> material;
+};
+
+// Planes through three points: unit normal and distance to the origin
+class PlaneSet
+{
+public:
+	void add(Vector& P0, Vector& P1, Vector& P2, Material* m);
+	int size() { return material.size(); }
+	Material* GetMaterial(uint32_t prim) { return material[prim]; }
+
+	int Closest(const PrimRef* refs, int count, Ray& r, float& t);
+	bool Any(const PrimRef* refs, int count, Ray& r, float tmax);
+	Vector getNormal(uint32_t prim) { return Vector(nx[prim], ny[prim], nz[prim]); }
+
+private:
+	vector<float> nx, ny, nz, d;
+	vector<Material*> material;
+};
+
+#endif
@@ -1,14 +1,15 @@
-#ifndef RAY_H
-#define RAY_H
-
-#include "vector.h"
-
-class Ray
-{
-public:
-	Ray(const Vector& o, const Vector& dir ) : origin(o), direction(dir) {};
-
-	Vector origin;
-	Vector direction;
-};
+#ifndef RAY_H
+#define RAY_H
+
+#include "vector.h"
+
+class Ray
+{
+public:
+	Ray() {};
+	Ray(const Vector& o, const Vector& dir ) : origin(o), direction(dir) {};
+
+	Vector origin;
+	Vector direction;
+};
 #endif
\ No newline at end of file
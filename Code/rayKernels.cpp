@@ -0,0 +1,583 @@
+#include "rayKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only compile the AVX2 intrinsics in functions built for it; MSVC always does
+#if defined(__GNUC__)
+#define TARGET_SSE __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE
+#define TARGET_AVX2
+#endif
+
+const char* kernel_names[] = { "scalar", "sse", "avx2" };
+
+static bool cpuSupports(KernelType kernel)
+{
+	if (kernel == KERNEL_SCALAR) return true;
+#if defined(KERNELS_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (kernel == KERNEL_SSE) return __builtin_cpu_supports("sse2");
+	return __builtin_cpu_supports("avx2");
+#elif defined(KERNELS_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	if (kernel == KERNEL_SSE) return (info[3] & (1 << 26)) != 0;
+	bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;   // OSXSAVE, XMM and YMM state
+	__cpuidex(info, 7, 0);
+	return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+KernelType bestKernel()
+{
+	if (cpuSupports(KERNEL_AVX2)) return KERNEL_AVX2;
+	if (cpuSupports(KERNEL_SSE)) return KERNEL_SSE;
+	return KERNEL_SCALAR;
+}
+
+static KernelType kernel = bestKernel();
+
+KernelType getKernel()
+{
+	return kernel;
+}
+
+bool setKernel(KernelType k)
+{
+	if (!cpuSupports(k)) return false;
+	kernel = k;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////// Triangles, scalar
+
+//
+// Ray/Triangle intersection test using Tomas Moller-Ben Trumbore algorithm, without branches:
+// a triangle is hit when none of the barycentric and distance tests rejects it.
+//
+
+static inline bool triangleHit(const TriangleArrays& mesh, uint32_t prim, Ray& r, float& t)
+{
+	const uint32_t* idx = &mesh.indices[3 * prim];
+	float p0x = mesh.vx[idx[0]], p0y = mesh.vy[idx[0]], p0z = mesh.vz[idx[0]];
+	float p1x = mesh.vx[idx[1]], p1y = mesh.vy[idx[1]], p1z = mesh.vz[idx[1]];
+	float p2x = mesh.vx[idx[2]], p2y = mesh.vy[idx[2]], p2z = mesh.vz[idx[2]];
+
+	float a = p0x - p1x, b = p0x - p2x, c = r.direction.x, d = p0x - r.origin.x;
+	float e = p0y - p1y, f = p0y - p2y, g = r.direction.y, h = p0y - r.origin.y;
+	float i = p0z - p1z, j = p0z - p2z, k = r.direction.z, l = p0z - r.origin.z;
+
+	float m = f * k - g * j, n = h * k - g * l, p = f * l - h * j;
+	float q = g * i - e * k, s = e * j - f * i;
+
+	float inv_denom = 1.0f / (a * m + b * q + c * s);
+
+	float beta = (d * m - b * n - c * p) * inv_denom;
+	float ray = e * l - h * i;
+	float gamma = (a * n + d * q + c * ray) * inv_denom;
+	t = (a * p - b * ray + d * s) * inv_denom;
+
+	return !(beta < 0.0f) & !(gamma < 0.0f) & !(beta + gamma > 1.0f) & !(t < 0.0001f);
+}
+
+static int closestTriangleScalar(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float& t)
+{
+	int hit = -1;
+	float tn;
+
+	for (int n = 0; n < count; n++) {
+		if (triangleHit(mesh, refs[n].prim, r, tn) & (tn < t)) {
+			t = tn;
+			hit = n;
+		}
+	}
+	return hit;
+}
+
+static bool anyTriangleScalar(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	float tn;
+
+	for (int n = 0; n < count; n++)
+		if (triangleHit(mesh, refs[n].prim, r, tn) & (tn < tmax)) return true;
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Spheres, scalar
+
+// Ray/Sphere intersection: the smaller root from outside the sphere,
+// the positive one from inside
+static inline bool sphereHit(const SphereArrays& spheres, uint32_t prim, Ray& r, float& t)
+{
+	const float* s = &spheres.records[4 * prim];
+	float tx = s[0] - r.origin.x, ty = s[1] - r.origin.y, tz = s[2] - r.origin.z;
+	float b = r.direction.x * tx + r.direction.y * ty + r.direction.z * tz;
+	float c = tx * tx + ty * ty + tz * tz - s[3];
+
+	if (b <= 0.0f) return false;
+
+	float disc = b * b - c;
+
+	if (disc <= 0.0f) return false;
+
+	t = c > 0.0f ? b - sqrt(disc) : b + sqrt(disc);
+	return t > 0.0f;
+}
+
+static int closestSphereScalar(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float& t)
+{
+	int hit = -1;
+	float tn;
+
+	for (int n = 0; n < count; n++) {
+		if (sphereHit(spheres, refs[n].prim, r, tn) && tn < t) {
+			t = tn;
+			hit = n;
+		}
+	}
+	return hit;
+}
+
+static bool anySphereScalar(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	float tn;
+
+	for (int n = 0; n < count; n++)
+		if (sphereHit(spheres, refs[n].prim, r, tn) && tn < tmax) return true;
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Ray packets, scalar
+
+PacketRays::PacketRays(Ray* rays, int a_count) : count(a_count)
+{
+	for (int i = 0; i < PACKET_SIZE; i++) {
+		Ray& r = rays[i < count ? i : 0];
+		ox[i] = r.origin.x; oy[i] = r.origin.y; oz[i] = r.origin.z;
+		ix[i] = 1.0f / r.direction.x; iy[i] = 1.0f / r.direction.y; iz[i] = 1.0f / r.direction.z;
+	}
+}
+
+// Same arithmetic as BVH::IntersectNode(); the SIMD min and max return the second operand on a
+// NaN as these do, so all the kernels give the same masks
+static inline float minf(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float maxf(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+static uint32_t boxPacketScalar(const Vector& min, const Vector& max, const PacketRays& p, const float* tmax, float* tEntry)
+{
+	uint32_t mask = 0;
+
+	for (int i = 0; i < p.count; i++) {
+		float tx0 = (min.x - p.ox[i]) * p.ix[i], tx1 = (max.x - p.ox[i]) * p.ix[i];
+		float ty0 = (min.y - p.oy[i]) * p.iy[i], ty1 = (max.y - p.oy[i]) * p.iy[i];
+		float tz0 = (min.z - p.oz[i]) * p.iz[i], tz1 = (max.z - p.oz[i]) * p.iz[i];
+
+		float t0 = maxf(maxf(minf(tx0, tx1), minf(ty0, ty1)), minf(tz0, tz1));
+		float t1 = minf(minf(maxf(tx0, tx1), maxf(ty0, ty1)), maxf(tz0, tz1));
+
+		tEntry[i] = t0;
+		mask |= (uint32_t)((t0 <= t1) & (t1 >= 0.0f) & (t0 < tmax[i])) << i;
+	}
+	return mask;
+}
+
+#ifdef KERNELS_X86
+
+// The closest of the hits given by the mask bits, first lane first, as the scalar loop does
+static inline int closestLane(int bits, const float* tl, int first, float& t, int hit)
+{
+	for (int lane = 0; bits; lane++, bits >>= 1) {
+		if ((bits & 1) && tl[lane] < t) {
+			t = tl[lane];
+			hit = first + lane;
+		}
+	}
+	return hit;
+}
+
+// Whether any of the hits given by the mask bits is nearer than tmax
+static inline bool anyLane(int bits, const float* tl, float tmax)
+{
+	for (int lane = 0; bits; lane++, bits >>= 1)
+		if ((bits & 1) && tl[lane] < tmax) return true;
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Triangles, SSE
+
+// Tests 4 triangles, given by their vertex indices; returns the mask of the hit ones
+TARGET_SSE static inline int triangles4(const TriangleArrays& mesh, const uint32_t* prims, Ray& r, float* tl)
+{
+	const uint32_t* i0 = &mesh.indices[3 * prims[0]], *i1 = &mesh.indices[3 * prims[1]];
+	const uint32_t* i2 = &mesh.indices[3 * prims[2]], *i3 = &mesh.indices[3 * prims[3]];
+#define LANES(arr, k) _mm_setr_ps(arr[i0[k]], arr[i1[k]], arr[i2[k]], arr[i3[k]])
+	__m128 p0x = LANES(mesh.vx, 0), p0y = LANES(mesh.vy, 0), p0z = LANES(mesh.vz, 0);
+	__m128 p1x = LANES(mesh.vx, 1), p1y = LANES(mesh.vy, 1), p1z = LANES(mesh.vz, 1);
+	__m128 p2x = LANES(mesh.vx, 2), p2y = LANES(mesh.vy, 2), p2z = LANES(mesh.vz, 2);
+#undef LANES
+
+	__m128 a = _mm_sub_ps(p0x, p1x), b = _mm_sub_ps(p0x, p2x), c = _mm_set1_ps(r.direction.x), d = _mm_sub_ps(p0x, _mm_set1_ps(r.origin.x));
+	__m128 e = _mm_sub_ps(p0y, p1y), f = _mm_sub_ps(p0y, p2y), g = _mm_set1_ps(r.direction.y), h = _mm_sub_ps(p0y, _mm_set1_ps(r.origin.y));
+	__m128 i = _mm_sub_ps(p0z, p1z), j = _mm_sub_ps(p0z, p2z), k = _mm_set1_ps(r.direction.z), l = _mm_sub_ps(p0z, _mm_set1_ps(r.origin.z));
+
+	__m128 m = _mm_sub_ps(_mm_mul_ps(f, k), _mm_mul_ps(g, j));
+	__m128 n = _mm_sub_ps(_mm_mul_ps(h, k), _mm_mul_ps(g, l));
+	__m128 p = _mm_sub_ps(_mm_mul_ps(f, l), _mm_mul_ps(h, j));
+	__m128 q = _mm_sub_ps(_mm_mul_ps(g, i), _mm_mul_ps(e, k));
+	__m128 s = _mm_sub_ps(_mm_mul_ps(e, j), _mm_mul_ps(f, i));
+
+	__m128 denom = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, m), _mm_mul_ps(b, q)), _mm_mul_ps(c, s));
+	__m128 inv_denom = _mm_div_ps(_mm_set1_ps(1.0f), denom);
+
+	__m128 beta = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(d, m), _mm_mul_ps(b, n)), _mm_mul_ps(c, p)), inv_denom);
+	__m128 ray = _mm_sub_ps(_mm_mul_ps(e, l), _mm_mul_ps(h, i));
+	__m128 gamma = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, n), _mm_mul_ps(d, q)), _mm_mul_ps(c, ray)), inv_denom);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(a, p), _mm_mul_ps(b, ray)), _mm_mul_ps(d, s)), inv_denom);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 hit = _mm_and_ps(_mm_cmpnlt_ps(beta, zero), _mm_cmpnlt_ps(gamma, zero));
+	hit = _mm_and_ps(hit, _mm_cmpngt_ps(_mm_add_ps(beta, gamma), _mm_set1_ps(1.0f)));
+	hit = _mm_and_ps(hit, _mm_cmpnlt_ps(t, _mm_set1_ps(0.0001f)));
+
+	_mm_storeu_ps(tl, t);
+	return _mm_movemask_ps(hit);
+}
+
+// Fills a group of width references, repeating the last one past count
+static inline int loadPrims(const PrimRef* refs, int first, int count, int width, uint32_t* prims)
+{
+	int n = count - first < width ? count - first : width;
+	for (int lane = 0; lane < width; lane++)
+		prims[lane] = refs[first + (lane < n ? lane : n - 1)].prim;
+	return (1 << n) - 1;
+}
+
+TARGET_SSE static int closestTriangleSSE(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float& t)
+{
+	uint32_t prims[4];
+	float tl[4];
+	int hit = -1;
+
+	for (int first = 0; first < count; first += 4) {
+		int valid = loadPrims(refs, first, count, 4, prims);
+		hit = closestLane(triangles4(mesh, prims, r, tl) & valid, tl, first, t, hit);
+	}
+	return hit;
+}
+
+TARGET_SSE static bool anyTriangleSSE(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	uint32_t prims[4];
+	float tl[4];
+
+	for (int first = 0; first < count; first += 4) {
+		int valid = loadPrims(refs, first, count, 4, prims);
+		if (anyLane(triangles4(mesh, prims, r, tl) & valid, tl, tmax)) return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Triangles, AVX2
+
+// Tests 8 triangles, given by their vertex indices; returns the mask of the hit ones. The lanes
+// are filled with scalar loads, which measured faster than the AVX2 gathers.
+TARGET_AVX2 static inline int triangles8(const TriangleArrays& mesh, const uint32_t* prims, Ray& r, float* tl)
+{
+	const uint32_t* i0 = &mesh.indices[3 * prims[0]], *i1 = &mesh.indices[3 * prims[1]], *i2 = &mesh.indices[3 * prims[2]], *i3 = &mesh.indices[3 * prims[3]];
+	const uint32_t* i4 = &mesh.indices[3 * prims[4]], *i5 = &mesh.indices[3 * prims[5]], *i6 = &mesh.indices[3 * prims[6]], *i7 = &mesh.indices[3 * prims[7]];
+#define LANES(arr, k) _mm256_setr_ps(arr[i0[k]], arr[i1[k]], arr[i2[k]], arr[i3[k]], arr[i4[k]], arr[i5[k]], arr[i6[k]], arr[i7[k]])
+	__m256 p0x = LANES(mesh.vx, 0), p0y = LANES(mesh.vy, 0), p0z = LANES(mesh.vz, 0);
+	__m256 p1x = LANES(mesh.vx, 1), p1y = LANES(mesh.vy, 1), p1z = LANES(mesh.vz, 1);
+	__m256 p2x = LANES(mesh.vx, 2), p2y = LANES(mesh.vy, 2), p2z = LANES(mesh.vz, 2);
+#undef LANES
+
+	__m256 a = _mm256_sub_ps(p0x, p1x), b = _mm256_sub_ps(p0x, p2x), c = _mm256_set1_ps(r.direction.x), d = _mm256_sub_ps(p0x, _mm256_set1_ps(r.origin.x));
+	__m256 e = _mm256_sub_ps(p0y, p1y), f = _mm256_sub_ps(p0y, p2y), g = _mm256_set1_ps(r.direction.y), h = _mm256_sub_ps(p0y, _mm256_set1_ps(r.origin.y));
+	__m256 i = _mm256_sub_ps(p0z, p1z), j = _mm256_sub_ps(p0z, p2z), k = _mm256_set1_ps(r.direction.z), l = _mm256_sub_ps(p0z, _mm256_set1_ps(r.origin.z));
+
+	__m256 m = _mm256_sub_ps(_mm256_mul_ps(f, k), _mm256_mul_ps(g, j));
+	__m256 n = _mm256_sub_ps(_mm256_mul_ps(h, k), _mm256_mul_ps(g, l));
+	__m256 p = _mm256_sub_ps(_mm256_mul_ps(f, l), _mm256_mul_ps(h, j));
+	__m256 q = _mm256_sub_ps(_mm256_mul_ps(g, i), _mm256_mul_ps(e, k));
+	__m256 s = _mm256_sub_ps(_mm256_mul_ps(e, j), _mm256_mul_ps(f, i));
+
+	__m256 denom = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, m), _mm256_mul_ps(b, q)), _mm256_mul_ps(c, s));
+	__m256 inv_denom = _mm256_div_ps(_mm256_set1_ps(1.0f), denom);
+
+	__m256 beta = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(d, m), _mm256_mul_ps(b, n)), _mm256_mul_ps(c, p)), inv_denom);
+	__m256 ray = _mm256_sub_ps(_mm256_mul_ps(e, l), _mm256_mul_ps(h, i));
+	__m256 gamma = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, n), _mm256_mul_ps(d, q)), _mm256_mul_ps(c, ray)), inv_denom);
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(a, p), _mm256_mul_ps(b, ray)), _mm256_mul_ps(d, s)), inv_denom);
+
+	__m256 zero = _mm256_setzero_ps();
+	__m256 hit = _mm256_and_ps(_mm256_cmp_ps(beta, zero, _CMP_NLT_UQ), _mm256_cmp_ps(gamma, zero, _CMP_NLT_UQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(beta, gamma), _mm256_set1_ps(1.0f), _CMP_NGT_UQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(0.0001f), _CMP_NLT_UQ));
+
+	_mm256_storeu_ps(tl, t);
+	return _mm256_movemask_ps(hit);
+}
+
+TARGET_AVX2 static int closestTriangleAVX2(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float& t)
+{
+	uint32_t prims[8];
+	float tl[8];
+	int hit = -1;
+
+	for (int first = 0; first < count; first += 8) {
+		if (count - first <= 4) {   // small leaves and the end of a run: half the width will do
+			int valid = loadPrims(refs, first, count, 4, prims);
+			return closestLane(triangles4(mesh, prims, r, tl) & valid, tl, first, t, hit);
+		}
+		int valid = loadPrims(refs, first, count, 8, prims);
+		hit = closestLane(triangles8(mesh, prims, r, tl) & valid, tl, first, t, hit);
+	}
+	return hit;
+}
+
+TARGET_AVX2 static bool anyTriangleAVX2(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	uint32_t prims[8];
+	float tl[8];
+
+	for (int first = 0; first < count; first += 8) {
+		if (count - first <= 4) {
+			int valid = loadPrims(refs, first, count, 4, prims);
+			return anyLane(triangles4(mesh, prims, r, tl) & valid, tl, tmax);
+		}
+		int valid = loadPrims(refs, first, count, 8, prims);
+		if (anyLane(triangles8(mesh, prims, r, tl) & valid, tl, tmax)) return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Spheres, SSE
+
+// Tests 4 spheres; returns the mask of the hit ones. Both roots are computed and the one
+// sphereHit() would take is selected per lane.
+TARGET_SSE static inline int spheres4(const SphereArrays& spheres, const uint32_t* prims, Ray& r, float* tl)
+{
+	__m128 x = _mm_loadu_ps(spheres.records + 4 * prims[0]), y = _mm_loadu_ps(spheres.records + 4 * prims[1]);
+	__m128 z = _mm_loadu_ps(spheres.records + 4 * prims[2]), sqRadius = _mm_loadu_ps(spheres.records + 4 * prims[3]);
+	_MM_TRANSPOSE4_PS(x, y, z, sqRadius);
+	__m128 tx = _mm_sub_ps(x, _mm_set1_ps(r.origin.x));
+	__m128 ty = _mm_sub_ps(y, _mm_set1_ps(r.origin.y));
+	__m128 tz = _mm_sub_ps(z, _mm_set1_ps(r.origin.z));
+
+	__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r.direction.x), tx), _mm_mul_ps(_mm_set1_ps(r.direction.y), ty)), _mm_mul_ps(_mm_set1_ps(r.direction.z), tz));
+	__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)), sqRadius);
+	__m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+	__m128 root = _mm_sqrt_ps(disc);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 outside = _mm_cmpgt_ps(c, zero);
+	__m128 t = _mm_or_ps(_mm_and_ps(outside, _mm_sub_ps(b, root)), _mm_andnot_ps(outside, _mm_add_ps(b, root)));
+
+	__m128 hit = _mm_and_ps(_mm_cmpnle_ps(b, zero), _mm_cmpnle_ps(disc, zero));
+	hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+
+	_mm_storeu_ps(tl, t);
+	return _mm_movemask_ps(hit);
+}
+
+TARGET_SSE static int closestSphereSSE(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float& t)
+{
+	uint32_t prims[4];
+	float tl[4];
+	int hit = -1;
+
+	for (int first = 0; first < count; first += 4) {
+		int valid = loadPrims(refs, first, count, 4, prims);
+		hit = closestLane(spheres4(spheres, prims, r, tl) & valid, tl, first, t, hit);
+	}
+	return hit;
+}
+
+TARGET_SSE static bool anySphereSSE(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	uint32_t prims[4];
+	float tl[4];
+
+	for (int first = 0; first < count; first += 4) {
+		int valid = loadPrims(refs, first, count, 4, prims);
+		if (anyLane(spheres4(spheres, prims, r, tl) & valid, tl, tmax)) return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Spheres, AVX2
+
+// Same as spheres4(): records i and i + 4 share a load, and the transpose works on both halves
+TARGET_AVX2 static inline int spheres8(const SphereArrays& spheres, const uint32_t* prims, Ray& r, float* tl)
+{
+#define LOAD2(a, b) _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(spheres.records + 4 * prims[a])), _mm_loadu_ps(spheres.records + 4 * prims[b]), 1)
+	__m256 r0 = LOAD2(0, 4), r1 = LOAD2(1, 5), r2 = LOAD2(2, 6), r3 = LOAD2(3, 7);
+#undef LOAD2
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+	__m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+	__m256 x = _mm256_shuffle_ps(t0, t2, 0x44), y = _mm256_shuffle_ps(t0, t2, 0xee);
+	__m256 z = _mm256_shuffle_ps(t1, t3, 0x44), sqRadius = _mm256_shuffle_ps(t1, t3, 0xee);
+	__m256 tx = _mm256_sub_ps(x, _mm256_set1_ps(r.origin.x));
+	__m256 ty = _mm256_sub_ps(y, _mm256_set1_ps(r.origin.y));
+	__m256 tz = _mm256_sub_ps(z, _mm256_set1_ps(r.origin.z));
+
+	__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r.direction.x), tx), _mm256_mul_ps(_mm256_set1_ps(r.direction.y), ty)), _mm256_mul_ps(_mm256_set1_ps(r.direction.z), tz));
+	__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)), sqRadius);
+	__m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+	__m256 root = _mm256_sqrt_ps(disc);
+
+	__m256 zero = _mm256_setzero_ps();
+	__m256 t = _mm256_blendv_ps(_mm256_add_ps(b, root), _mm256_sub_ps(b, root), _mm256_cmp_ps(c, zero, _CMP_GT_OQ));
+
+	__m256 hit = _mm256_and_ps(_mm256_cmp_ps(b, zero, _CMP_NLE_UQ), _mm256_cmp_ps(disc, zero, _CMP_NLE_UQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+
+	_mm256_storeu_ps(tl, t);
+	return _mm256_movemask_ps(hit);
+}
+
+TARGET_AVX2 static int closestSphereAVX2(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float& t)
+{
+	uint32_t prims[8];
+	float tl[8];
+	int hit = -1;
+
+	for (int first = 0; first < count; first += 8) {
+		if (count - first <= 4) {
+			int valid = loadPrims(refs, first, count, 4, prims);
+			return closestLane(spheres4(spheres, prims, r, tl) & valid, tl, first, t, hit);
+		}
+		int valid = loadPrims(refs, first, count, 8, prims);
+		hit = closestLane(spheres8(spheres, prims, r, tl) & valid, tl, first, t, hit);
+	}
+	return hit;
+}
+
+TARGET_AVX2 static bool anySphereAVX2(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+	uint32_t prims[8];
+	float tl[8];
+
+	for (int first = 0; first < count; first += 8) {
+		if (count - first <= 4) {
+			int valid = loadPrims(refs, first, count, 4, prims);
+			return anyLane(spheres4(spheres, prims, r, tl) & valid, tl, tmax);
+		}
+		int valid = loadPrims(refs, first, count, 8, prims);
+		if (anyLane(spheres8(spheres, prims, r, tl) & valid, tl, tmax)) return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////// Ray packets, SSE and AVX2
+
+// The lanes past p.count are computed on the copies of the first ray and masked out
+TARGET_SSE static uint32_t boxPacketSSE(const Vector& min, const Vector& max, const PacketRays& p, const float* tmax, float* tEntry)
+{
+	uint32_t mask = 0;
+
+	for (int i = 0; i < p.count; i += 4) {
+		__m128 ox = _mm_loadu_ps(p.ox + i), oy = _mm_loadu_ps(p.oy + i), oz = _mm_loadu_ps(p.oz + i);
+		__m128 ix = _mm_loadu_ps(p.ix + i), iy = _mm_loadu_ps(p.iy + i), iz = _mm_loadu_ps(p.iz + i);
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.x), ox), ix), tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.x), ox), ix);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.y), oy), iy), ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.y), oy), iy);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min.z), oz), iz), tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max.z), oz), iz);
+
+		__m128 t0 = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_min_ps(tz0, tz1));
+		__m128 t1 = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_max_ps(tz0, tz1));
+
+		_mm_storeu_ps(tEntry + i, t0);
+		__m128 hit = _mm_and_ps(_mm_cmple_ps(t0, t1), _mm_cmpge_ps(t1, _mm_setzero_ps()));
+		hit = _mm_and_ps(hit, _mm_cmplt_ps(t0, _mm_loadu_ps(tmax + i)));
+		mask |= (uint32_t)_mm_movemask_ps(hit) << i;
+	}
+	return mask & ((1u << p.count) - 1);
+}
+
+TARGET_AVX2 static uint32_t boxPacketAVX2(const Vector& min, const Vector& max, const PacketRays& p, const float* tmax, float* tEntry)
+{
+	if (p.count <= 4) return boxPacketSSE(min, max, p, tmax, tEntry);
+
+	uint32_t mask = 0;
+
+	for (int i = 0; i < p.count; i += 8) {
+		__m256 ox = _mm256_loadu_ps(p.ox + i), oy = _mm256_loadu_ps(p.oy + i), oz = _mm256_loadu_ps(p.oz + i);
+		__m256 ix = _mm256_loadu_ps(p.ix + i), iy = _mm256_loadu_ps(p.iy + i), iz = _mm256_loadu_ps(p.iz + i);
+		__m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min.x), ox), ix), tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max.x), ox), ix);
+		__m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min.y), oy), iy), ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max.y), oy), iy);
+		__m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(min.z), oz), iz), tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(max.z), oz), iz);
+
+		__m256 t0 = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)), _mm256_min_ps(tz0, tz1));
+		__m256 t1 = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)), _mm256_max_ps(tz0, tz1));
+
+		_mm256_storeu_ps(tEntry + i, t0);
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ), _mm256_cmp_ps(t1, _mm256_setzero_ps(), _CMP_GE_OQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(t0, _mm256_loadu_ps(tmax + i), _CMP_LT_OQ));
+		mask |= (uint32_t)_mm256_movemask_ps(hit) << i;
+	}
+	return mask & ((1u << p.count) - 1);
+}
+
+#endif
+
+int closestTriangle(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float& t)
+{
+#ifdef KERNELS_X86
+	if (kernel == KERNEL_AVX2) return closestTriangleAVX2(mesh, refs, count, r, t);
+	if (kernel == KERNEL_SSE) return closestTriangleSSE(mesh, refs, count, r, t);
+#endif
+	return closestTriangleScalar(mesh, refs, count, r, t);
+}
+
+bool anyTriangle(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+#ifdef KERNELS_X86
+	if (kernel == KERNEL_AVX2) return anyTriangleAVX2(mesh, refs, count, r, tmax);
+	if (kernel == KERNEL_SSE) return anyTriangleSSE(mesh, refs, count, r, tmax);
+#endif
+	return anyTriangleScalar(mesh, refs, count, r, tmax);
+}
+
+int closestSphere(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float& t)
+{
+#ifdef KERNELS_X86
+	if (kernel == KERNEL_AVX2) return closestSphereAVX2(spheres, refs, count, r, t);
+	if (kernel == KERNEL_SSE) return closestSphereSSE(spheres, refs, count, r, t);
+#endif
+	return closestSphereScalar(spheres, refs, count, r, t);
+}
+
+bool anySphere(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float tmax)
+{
+#ifdef KERNELS_X86
+	if (kernel == KERNEL_AVX2) return anySphereAVX2(spheres, refs, count, r, tmax);
+	if (kernel == KERNEL_SSE) return anySphereSSE(spheres, refs, count, r, tmax);
+#endif
+	return anySphereScalar(spheres, refs, count, r, tmax);
+}
+
+uint32_t boxPacket(const Vector& min, const Vector& max, const PacketRays& p, const float* tmax, float* tEntry)
+{
+#ifdef KERNELS_X86
+	if (kernel == KERNEL_AVX2) return boxPacketAVX2(min, max, p, tmax, tEntry);
+	if (kernel == KERNEL_SSE) return boxPacketSSE(min, max, p, tmax, tEntry);
+#endif
+	return boxPacketScalar(min, max, p, tmax, tEntry);
+}
@@ -0,0 +1,74 @@
+#ifndef RAY_KERNELS_H
+#define RAY_KERNELS_H
+
+#include <stdint.h>
+#include "vector.h"
+#include "ray.h"
+#include "primitives.h"
+
+// Intersection loops of one ray against a run of primitives of the same set, in a scalar,
+// an SSE (4 wide) and an AVX2 (8 wide) version. The widest one the CPU supports is picked at
+// run time. They all do the arithmetic of the scalar loop in the same order, without fused
+// multiply-adds, and report the hits in reference order, so they give bit-identical images.
+
+typedef enum { KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2 } KernelType;
+extern const char* kernel_names[];
+
+KernelType bestKernel();             // widest kernel the CPU can run
+KernelType getKernel();
+bool setKernel(KernelType kernel);   // false if the CPU cannot run it
+
+// Triangles of a mesh: vertex arrays and an index triple per triangle (see TriangleMesh)
+struct TriangleArrays {
+	const float* vx;
+	const float* vy;
+	const float* vz;
+	const uint32_t* indices;
+};
+
+// Position in refs of the closest hit nearer than t, which gets its distance, or -1; and
+// whether any hit is nearer than tmax
+int closestTriangle(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float& t);
+bool anyTriangle(const TriangleArrays& mesh, const PrimRef* refs, int count, Ray& r, float tmax);
+
+// Spheres: a record of center x, y, z and squared radius per sphere (see SphereSet). The
+// SIMD kernels load one record per lane and transpose them into lanes of x, y, z and radius².
+struct SphereArrays {
+	const float* records;
+};
+
+int closestSphere(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float& t);
+bool anySphere(const SphereArrays& spheres, const PrimRef* refs, int count, Ray& r, float tmax);
+
+// Packets of up to PACKET_SIZE rays traced together (see Accelerator::TraversePacket), one array
+// per coordinate. The lanes past count repeat the first ray and are left out of the masks.
+#define PACKET_SIZE 16
+
+struct PacketRays {
+	PacketRays(Ray* rays, int count);
+
+	float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+	float ix[PACKET_SIZE], iy[PACKET_SIZE], iz[PACKET_SIZE];   // reciprocals of the directions
+	int count;
+};
+
+// Lanes of the masks of a packet
+static inline int firstLane(uint32_t mask)
+{
+	int i = 0;
+	while (!(mask & (1u << i))) i++;
+	return i;
+}
+
+static inline int countLanes(uint32_t mask)
+{
+	int n = 0;
+	for (; mask; mask &= mask - 1) n++;
+	return n;
+}
+
+// Slab test of a box against a packet: the mask of the rays that enter it before their tmax,
+// whose entry distances go to tEntry. tmax and tEntry hold PACKET_SIZE floats.
+uint32_t boxPacket(const Vector& min, const Vector& max, const PacketRays& p, const float* tmax, float* tEntry);
+
+#endif
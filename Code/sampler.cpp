@@ -1,11 +1,205 @@
-#include "vector.h"
-#include "maths.h"
-
-// Sampling with rejection method
-Vector sample_unit_disk(void) {
-	Vector p;
-	do {
-		p = Vector(rand_float(), rand_float(), 0.0) * 2 - Vector(1.0, 1.0, 0.0);
-	} while (p*p >= 1.0);
-	return p;
+#include <math.h>
+
+#include "sampler.h"
+
+#define PI_F 3.141592653589793238462f
+
+static uint32_t hashInt(uint32_t x)   // lowbias32 (Wellons)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+static uint32_t hashCombine(uint32_t seed, uint32_t v)
+{
+	return seed ^ (hashInt(v) + 0x9e3779b9U + (seed << 6) + (seed >> 2));
+}
+
+static float toFloat(uint32_t x)   // in [0, 1[
+{
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static float frac(float x)
+{
+	return x - floorf(x);
+}
+
+static void random2D(PixelSample& s, uint32_t index, float& u, float& v)
+{
+	PCG32 rng(s.pixel(), index, hashCombine(s.frame, s.dim));
+	u = rng.nextFloat();
+	v = rng.nextFloat();
+}
+
+// Random permutation of [0, l[ selected by p, without tables (Kensler, "Correlated Multi-Jittered Sampling")
+static uint32_t permute(uint32_t i, uint32_t l, uint32_t p)
+{
+	uint32_t w = l - 1;
+	w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+	do {
+		i ^= p; i *= 0xe170893d; i ^= p >> 16; i ^= (i & w) >> 4;
+		i ^= p >> 8; i *= 0x0929eb3f; i ^= p >> 23; i ^= (i & w) >> 1;
+		i *= 1 | p >> 27; i *= 0x6935fa69; i ^= (i & w) >> 11; i *= 0x74dcb303;
+		i ^= (i & w) >> 2; i *= 0x9e501cc3; i ^= (i & w) >> 2; i *= 0xc860a3df;
+		i &= w; i ^= i >> 5;
+	} while (i >= l);
+	return (i + p) % l;
+}
+
+JitteredSampler::JitteredSampler(int spp) : Sampler(spp)
+{
+	n = (int)(sqrtf((float)spp) + 0.5f);
+	if (n < 1) n = 1;
+}
+
+void JitteredSampler::Get2D(PixelSample& s, float& u, float& v)
+{
+	random2D(s, s.index, u, v);
+	if (s.dim == DIM_PIXEL) {
+		// the strata are visited in a different order in every pixel, so that any
+		// number of samples (e.g. the first passes of a progressive render) covers the whole pixel
+		uint32_t k = permute(s.index % (n * n), n * n, hashCombine(s.pixel(), s.frame));
+		u = ((k / n) + u) / n;
+		v = ((k % n) + v) / n;
+	}
+	s.dim++;
+}
+
+/////////////////////////////////////////////////////////////////////// Halton
+
+static float radicalInverse(uint32_t i, int base)
+{
+	float invBase = 1.0f / base, f = invBase, r = 0.0f;
+	while (i > 0) {
+		r += f * (i % base);
+		i /= base;
+		f *= invBase;
+	}
+	return r < 1.0f ? r : 0.99999994f;
+}
+
+// Order in which the dimensions other than the pixel position take the points of a pixel
+static uint32_t shuffledIndex(PixelSample& s, uint32_t spp)
+{
+	if (s.dim == DIM_PIXEL) return s.index;
+	uint32_t first = s.index - s.index % spp;
+	return first + permute(s.index - first, spp, hashCombine(hashCombine(s.pixel(), s.frame), s.dim));
+}
+
+// Every dimension uses the well distributed (2, 3) Halton points: higher prime bases leave most of
+// their strata empty with only a few samples per pixel. The other dimensions take the points in
+// an order shuffled per pixel and dimension, so that they are not correlated with the pixel position.
+void HaltonSampler::Get2D(PixelSample& s, float& u, float& v)
+{
+	uint32_t index = shuffledIndex(s, spp);
+
+	// Cranley-Patterson rotation, one per pixel and dimension: the same points in every pixel would show up as a pattern
+	float du, dv;
+	random2D(s, 0, du, dv);
+	u = frac(radicalInverse(index, 2) + du);
+	v = frac(radicalInverse(index, 3) + dv);
+	s.dim++;
+}
+
+/////////////////////////////////////////////////////////////////////// Sobol
+
+static uint32_t reverseBits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffU) << 8) | ((x & 0xff00ff00U) >> 8);
+	x = ((x & 0x0f0f0f0fU) << 4) | ((x & 0xf0f0f0f0U) >> 4);
+	x = ((x & 0x33333333U) << 2) | ((x & 0xccccccccU) >> 2);
+	x = ((x & 0x55555555U) << 1) | ((x & 0xaaaaaaaaU) >> 1);
+	return x;
+}
+
+static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cU;
+	x ^= x * 0xb82f1e52U;
+	x ^= x * 0xc7afe638U;
+	x ^= x * 0x8d22f6e6U;
+	return x;
+}
+
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+	return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+// first two Sobol dimensions: van der Corput, and the one with direction numbers v_k = v_k-1 ^ (v_k-1 >> 1)
+static void sobol2D(uint32_t index, uint32_t& x, uint32_t& y)
+{
+	uint32_t d = 1U << 31;
+	x = reverseBits(index);
+	y = 0;
+	for (; index; index >>= 1, d ^= d >> 1)
+		if (index & 1) y ^= d;
+}
+
+void SobolSampler::Get2D(PixelSample& s, float& u, float& v)
+{
+	uint32_t seed = hashCombine(hashCombine(s.pixel(), s.frame), s.dim);
+	uint32_t x, y;
+
+	sobol2D(nestedUniformScramble(s.index, seed), x, y);   // shuffle: each dimension pairs the points differently
+	u = toFloat(nestedUniformScramble(x, hashCombine(seed, 0)));
+	v = toFloat(nestedUniformScramble(y, hashCombine(seed, 1)));
+	s.dim++;
+}
+
+/////////////////////////////////////////////////////////////////////// Blue noise
+
+static float interleavedGradientNoise(float x, float y)
+{
+	return frac(52.9829189f * frac(0.06711056f * x + 0.00583715f * y));
+}
+
+void BlueNoiseSampler::Get2D(PixelSample& s, float& u, float& v)
+{
+	const double a1 = 0.7548776662466927, a2 = 0.5698402909980532;   // 1/g, 1/g^2 with g^3 = g + 1
+
+	// the noise is moved by a different offset for each dimension and frame
+	float ox = 5.588238f * (float)(s.dim + 4 * (s.frame & 255)), oy = 3.117183f * (float)(s.dim + 1);
+	float du = interleavedGradientNoise(s.x + ox, s.y + oy);
+	float dv = interleavedGradientNoise(s.y + oy + 17.0f, s.x + ox + 29.0f);
+
+	uint32_t index = shuffledIndex(s, spp);
+	u = frac((float)fmod(0.5 + a1 * index, 1.0) + du);
+	v = frac((float)fmod(0.5 + a2 * index, 1.0) + dv);
+	s.dim++;
+}
+
+/////////////////////////////////////////////////////////////////////// Warping
+
+// Concentric mapping of the unit square onto the unit disk (Shirley and Chiu):
+// unlike rejection it keeps the stratification of the input points
+Vector sample_unit_disk(float u, float v) {
+	float a = 2.0f * u - 1.0f, b = 2.0f * v - 1.0f;
+	float r, phi;
+
+	if (a == 0.0f && b == 0.0f) return Vector(0.0, 0.0, 0.0);
+	if (a * a > b * b) {
+		r = a;
+		phi = (PI_F / 4) * (b / a);
+	}
+	else {
+		r = b;
+		phi = (PI_F / 2) - (PI_F / 4) * (a / b);
+	}
+	return Vector(r * cosf(phi), r * sinf(phi), 0.0);
+}
+
+// Uniform point on the unit sphere
+Vector sample_unit_sphere(float u, float v) {
+	float z = 1.0f - 2.0f * u;
+	float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+	float phi = 2.0f * PI_F * v;
+	return Vector(r * cosf(phi), r * sinf(phi), z);
 }
\ No newline at end of file
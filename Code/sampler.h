@@ -1,3 +1,113 @@
-#include "vector.h"
-
-Vector sample_unit_disk(void);
\ No newline at end of file
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include "vector.h"
+
+// PCG32 random number generator (O'Neill, pcg-random.org): 64 bits of state, no global data.
+// Generators are seeded from (pixel, sample, stream), so the image does not depend on which
+// thread renders which pixel nor in which order.
+
+class PCG32
+{
+public:
+	PCG32(uint32_t pixel, uint32_t sample, uint32_t stream) {
+		state = 0;
+		inc = ((uint64_t)stream << 1) | 1u;
+		nextUInt();
+		state += mix(((uint64_t)pixel << 32) | sample);
+		nextUInt();
+	}
+
+	uint32_t nextUInt() {
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+		uint32_t rot = (uint32_t)(old >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+	}
+
+	float nextFloat() {   // in [0, 1[
+		return (nextUInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t state, inc;
+
+	static uint64_t mix(uint64_t x) {   // splitmix64 finalizer, so that neighbour pixels get unrelated states
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+};
+
+// Identifies one sample of one pixel while its ray tree is traced. Every random decision takes
+// the next 2D dimension: 0 is the position in the pixel, 1 the lens, then the area light samples
+// in the order they are needed.
+
+struct PixelSample {
+	uint32_t x, y, index, frame;
+	uint32_t dim;
+
+	PixelSample(uint32_t a_x, uint32_t a_y, uint32_t a_index, uint32_t a_frame) : x(a_x), y(a_y), index(a_index), frame(a_frame), dim(0) {}
+
+	uint32_t pixel() { return (y << 16) | x; }
+};
+
+#define DIM_PIXEL 0
+#define DIM_LENS 1
+
+// Generates the 2D sample points in [0, 1[^2. The points of a dimension are well distributed over
+// the samples of a pixel, while different pixels and dimensions are decorrelated from each other.
+// The samplers hold no mutable state, so one instance is shared by all the render threads.
+
+class Sampler
+{
+public:
+	Sampler(int a_spp) : spp(a_spp) {}
+	virtual ~Sampler() {}
+
+	virtual void Get2D(PixelSample& s, float& u, float& v) = 0;
+
+protected:
+	int spp;   // samples per pixel
+};
+
+// SPP_N x SPP_N stratified pixel positions, independent random numbers for the other dimensions
+class JitteredSampler : public Sampler
+{
+public:
+	JitteredSampler(int spp);
+	void Get2D(PixelSample& s, float& u, float& v);
+private:
+	int n;
+};
+
+// Halton points in bases 2 and 3, shuffled per dimension and randomly shifted per pixel
+class HaltonSampler : public Sampler
+{
+public:
+	HaltonSampler(int spp) : Sampler(spp) {}
+	void Get2D(PixelSample& s, float& u, float& v);
+};
+
+// 2D Sobol points with hash-based Owen scrambling, shuffled per pixel and dimension (Burley 2020)
+class SobolSampler : public Sampler
+{
+public:
+	SobolSampler(int spp) : Sampler(spp) {}
+	void Get2D(PixelSample& s, float& u, float& v);
+};
+
+// Roberts' R2 sequence shifted per pixel by interleaved gradient noise (Jimenez 2014):
+// a cheap approximation of blue noise, so the remaining error looks like fine grain instead of blotches
+class BlueNoiseSampler : public Sampler
+{
+public:
+	BlueNoiseSampler(int spp) : Sampler(spp) {}
+	void Get2D(PixelSample& s, float& u, float& v);
+};
+
+Vector sample_unit_disk(float u, float v);
+Vector sample_unit_sphere(float u, float v);
+#endif
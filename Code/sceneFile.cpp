@@ -0,0 +1,544 @@
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <charconv>
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "sceneFile.h"
+
+#define MIN(a, b)		( ( a ) < ( b ) ? ( a ) : ( b ) )
+
+SceneDesc::SceneDesc()
+{
+	memset(&header, 0, sizeof(header));
+	header.magic = P3B_MAGIC;
+	header.version = P3B_VERSION;
+}
+
+SceneView SceneDesc::view()
+{
+	header.numMaterials = materials.size();
+	header.numLights = lights.size();
+	header.numVertices = vertices.size() / 3;
+	header.numTriangles = triangles.size();
+	header.numSpheres = spheres.size();
+	header.numBoxes = boxes.size();
+	header.numPlanes = planes.size();
+	header.numObjects = order.size();
+
+	SceneView v;
+	v.header = &header;
+	v.materials = materials.data();
+	v.lights = lights.data();
+	v.vertices = vertices.data();
+	v.triangles = triangles.data();
+	v.spheres = spheres.data();
+	v.boxes = boxes.data();
+	v.planes = planes.data();
+	v.order = order.data();
+	return v;
+}
+
+/////////////////////////////////////////////////////////////////////// Mapped files
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* name)
+{
+	Close();
+#ifdef _WIN32
+	FILE* file = fopen(name, "rb");
+	if (file == NULL) return false;
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* buffer = (char*)malloc(size ? size : 1);
+	bool ok = buffer != NULL && fread(buffer, 1, size, file) == size;
+	fclose(file);
+	if (!ok) { free(buffer); size = 0; return false; }
+	data = buffer;
+	return true;
+#else
+	int fd = open(name, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) { close(fd); return false; }
+	size = st.st_size;
+	if (size == 0) { close(fd); data = ""; return true; }
+
+	void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);   // the mapping stays valid
+	if (p == MAP_FAILED) { size = 0; return false; }
+
+	data = (const char*)p;
+	mapped = true;
+	return true;
+#endif
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	free((void*)data);
+#else
+	if (mapped) munmap((void*)data, size);
+#endif
+	data = NULL;
+	size = 0;
+	mapped = false;
+}
+
+/////////////////////////////////////////////////////////////////////// P3F text format
+
+// The .p3f file is memory mapped and split in chunks that start at a record, which are parsed in
+// parallel and then appended in file order. Numbers are read with from_chars, which does not look
+// at the locale and gives the same correctly rounded values as the istream >> used before.
+
+#define P3F_MIN_CHUNK (256 * 1024)   // smaller files are parsed by a single thread
+#define P3B_CARRY_MATERIAL -2        // object before the first "f" of its chunk: material set by an earlier chunk
+
+// Index of the bitwise equal vertices already in a vertex array: the .p3f repeats the vertices
+// shared by several triangles in every "p" record, the description keeps a single copy
+class VertexWelder
+{
+public:
+	uint32_t add(vector<float>& vertices, const float* v) {
+		VertexKey key;
+		memcpy(key.bits, v, sizeof(key.bits));
+		auto it = welded.find(key);
+		if (it == welded.end()) {
+			it = welded.insert(make_pair(key, (uint32_t)(vertices.size() / 3))).first;
+			vertices.insert(vertices.end(), v, v + 3);
+		}
+		return it->second;
+	}
+
+private:
+	struct VertexKey {
+		uint32_t bits[3];
+		bool operator==(const VertexKey& o) const { return !memcmp(bits, o.bits, sizeof(bits)); }
+	};
+	struct VertexHash {
+		size_t operator()(const VertexKey& k) const { return (k.bits[0] * 73856093u) ^ (k.bits[1] * 19349663u) ^ (k.bits[2] * 83492791u); }
+	};
+	unordered_map<VertexKey, uint32_t, VertexHash> welded;
+};
+
+struct P3FChunk {
+	SceneDesc desc;                  // material indices local to the chunk
+	bool hasBgColor = false, hasSkybox = false;
+	bool stopped = false;            // unknown record: the file is not read further
+};
+
+class P3FReader
+{
+public:
+	P3FReader(const char* begin, const char* end) : p(begin), end(end) {}
+
+	bool token(string& t) {
+		skipSpace();
+		const char* start = p;
+		while (p < end && !isSpace(*p)) p++;
+		t.assign(start, p - start);
+		return p > start;
+	}
+
+	void expect(const char* name) {   // like next_token(): complains but carries on
+		string t;
+		token(t);
+		if (t != name)
+			cerr << "'" << name << "' expected.\n";
+	}
+
+	template <typename T> bool number(T& value) {
+		skipSpace();
+		if (p < end && *p == '+') p++;
+		from_chars_result r = from_chars(p, end, value);
+		if (r.ec != errc()) return false;
+		p = r.ptr;
+		return true;
+	}
+
+	bool vec(float* f) { return number(f[0]) && number(f[1]) && number(f[2]); }
+
+	void skipLine() {
+		while (p < end && *p != '\n') p++;
+	}
+
+private:
+	const char* p;
+	const char* end;
+
+	static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+	void skipSpace() { while (p < end && isSpace(*p)) p++; }
+};
+
+static void addObject(SceneDesc& desc, P3BObjectType type, size_t index)
+{
+	desc.order.push_back(((uint32_t)type << P3B_TYPE_SHIFT) | (uint32_t)index);
+}
+
+static void parseChunk(const char* begin, const char* end, P3FChunk& chunk)
+{
+	P3FReader file(begin, end);
+	SceneDesc& desc = chunk.desc;
+	VertexWelder welder;
+	int material = P3B_CARRY_MATERIAL;
+	string cmd;
+	bool ok = true;
+
+	while (ok && file.token(cmd))
+	{
+		if (cmd == "f")   //Material
+		{
+			double Kd, Ks, Shine, T, ior;
+			P3BMaterial m;
+
+			ok = file.vec(m.diffColor) && file.number(Kd) && file.vec(m.specColor) && file.number(Ks) &&
+				file.number(Shine) && file.number(T) && file.number(ior);
+			m.Kd = Kd; m.Ks = Ks; m.shine = Shine; m.T = T; m.ior = ior;
+			material = desc.materials.size();
+			desc.materials.push_back(m);
+		}
+
+		else if (cmd == "s")    //Sphere
+		{
+			P3BSphere s;
+			ok = file.vec(s.center) && file.number(s.radius);
+			s.material = material;
+			addObject(desc, P3B_SPHERE, desc.spheres.size());
+			desc.spheres.push_back(s);
+		}
+
+		else if (cmd == "box")    //axis aligned box
+		{
+			P3BBox b;
+			ok = file.vec(b.min) && file.vec(b.max);
+			b.material = material;
+			addObject(desc, P3B_BOX, desc.boxes.size());
+			desc.boxes.push_back(b);
+		}
+		else if (cmd == "p")  // Polygon: just accepts triangles for now
+		{
+			unsigned total_vertices;
+			ok = file.number(total_vertices);
+			if (ok && total_vertices == 3)
+			{
+				P3BTriangle t;
+				float v[3][3];
+				ok = file.vec(v[0]) && file.vec(v[1]) && file.vec(v[2]);
+				for (int i = 0; i < 3; i++)
+					t.v[i] = welder.add(desc.vertices, v[i]);
+				t.material = material;
+				addObject(desc, P3B_TRIANGLE, desc.triangles.size());
+				desc.triangles.push_back(t);
+			}
+			else
+			{
+				cerr << "Unsupported number of vertices.\n";
+				chunk.stopped = true;
+				break;
+			}
+		}
+
+		else if (cmd == "pl")  // General Plane
+		{
+			P3BPlane p;
+			ok = file.vec(p.points[0]) && file.vec(p.points[1]) && file.vec(p.points[2]);
+			p.material = material;
+			addObject(desc, P3B_PLANE, desc.planes.size());
+			desc.planes.push_back(p);
+		}
+
+		else if (cmd == "l")  // Need to check light color since by default is white
+		{
+			P3BLight l;
+			ok = file.vec(l.position) && file.vec(l.color);
+			desc.lights.push_back(l);
+		}
+		else if (cmd == "v")
+		{
+			P3BCamera& c = desc.header.camera;
+
+			file.expect("from");
+			ok = file.vec(c.from);
+			file.expect("at");
+			ok = ok && file.vec(c.at);
+			file.expect("up");
+			ok = ok && file.vec(c.up);
+			file.expect("angle");
+			ok = ok && file.number(c.fov);
+			file.expect("hither");
+			ok = ok && file.number(c.hither);
+			file.expect("resolution");
+			ok = ok && file.number(c.resX) && file.number(c.resY);
+			file.expect("aperture");
+			ok = ok && file.number(c.aperture);
+			file.expect("focal");
+			ok = ok && file.number(c.focal);
+			desc.header.hasCamera = 1;
+		}
+
+		else if (cmd == "bclr")   //Background color
+		{
+			ok = file.vec(desc.header.bgColor);
+			chunk.hasBgColor = true;
+		}
+
+		else if (cmd == "env")
+		{
+			string token;
+			file.token(token);
+			snprintf(desc.header.skybox, sizeof(desc.header.skybox), "%s", token.c_str());
+			chunk.hasSkybox = true;
+		}
+		else if (cmd[0] == '#')
+		{
+			file.skipLine();
+		}
+		else
+		{
+			cerr << "unknown command '" << cmd << "'.\n";
+			chunk.stopped = true;
+			break;
+		}
+	}
+
+	if (!ok) {
+		cerr << "Invalid number in the P3F file.\n";
+		chunk.stopped = true;
+	}
+}
+
+// True if the line starting at p begins a record, so that a chunk can start there.
+// The lines of a "v" record start with from, at, up... which are not record names.
+static bool isRecordStart(const char* p, const char* end)
+{
+	static const char* records[] = { "f", "s", "box", "p", "pl", "l", "v", "bclr", "env" };
+
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	if (p < end && *p == '#') return true;
+
+	const char* start = p;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+	for (int i = 0; i < (int)(sizeof(records) / sizeof(records[0])); i++)
+		if (strlen(records[i]) == (size_t)(p - start) && !strncmp(records[i], start, p - start))
+			return true;
+	return false;
+}
+
+// Appends a chunk to the scene, moving its indices past the ones of the previous chunks
+static void mergeChunk(SceneDesc& desc, P3FChunk& chunk, int& lastMaterial)
+{
+	SceneDesc& c = chunk.desc;
+	int materialBase = desc.materials.size();
+	uint32_t vertexBase = desc.vertices.size() / 3;
+	uint32_t base[4] = { (uint32_t)desc.triangles.size(), (uint32_t)desc.spheres.size(), (uint32_t)desc.boxes.size(), (uint32_t)desc.planes.size() };
+
+	auto material = [&](int32_t m) { return m == P3B_CARRY_MATERIAL ? lastMaterial : materialBase + m; };
+
+	desc.materials.insert(desc.materials.end(), c.materials.begin(), c.materials.end());
+	desc.lights.insert(desc.lights.end(), c.lights.begin(), c.lights.end());
+	desc.vertices.insert(desc.vertices.end(), c.vertices.begin(), c.vertices.end());
+
+	for (size_t i = 0; i < c.triangles.size(); i++) {
+		P3BTriangle t = c.triangles[i];
+		t.v[0] += vertexBase; t.v[1] += vertexBase; t.v[2] += vertexBase;
+		t.material = material(t.material);
+		desc.triangles.push_back(t);
+	}
+	for (size_t i = 0; i < c.spheres.size(); i++) {
+		desc.spheres.push_back(c.spheres[i]);
+		desc.spheres.back().material = material(c.spheres[i].material);
+	}
+	for (size_t i = 0; i < c.boxes.size(); i++) {
+		desc.boxes.push_back(c.boxes[i]);
+		desc.boxes.back().material = material(c.boxes[i].material);
+	}
+	for (size_t i = 0; i < c.planes.size(); i++) {
+		desc.planes.push_back(c.planes[i]);
+		desc.planes.back().material = material(c.planes[i].material);
+	}
+	for (size_t i = 0; i < c.order.size(); i++) {
+		uint32_t type = c.order[i] >> P3B_TYPE_SHIFT;
+		desc.order.push_back(c.order[i] + base[type]);
+	}
+
+	if (c.header.hasCamera) {
+		desc.header.camera = c.header.camera;
+		desc.header.hasCamera = 1;
+	}
+	if (chunk.hasBgColor)
+		memcpy(desc.header.bgColor, c.header.bgColor, sizeof(desc.header.bgColor));
+	if (chunk.hasSkybox)
+		memcpy(desc.header.skybox, c.header.skybox, sizeof(desc.header.skybox));
+	if (!c.materials.empty())
+		lastMaterial = materialBase + c.materials.size() - 1;
+}
+
+// Welds the vertices merged from several chunks, which may repeat some of the vertices of
+// other chunks
+static void weld_vertices(SceneDesc& desc)
+{
+	VertexWelder welder;
+	vector<float> vertices;
+	vector<uint32_t> remap(desc.vertices.size() / 3);
+
+	for (size_t i = 0; i < remap.size(); i++)
+		remap[i] = welder.add(vertices, &desc.vertices[3 * i]);
+	desc.vertices.swap(vertices);
+	for (size_t i = 0; i < desc.triangles.size(); i++)
+		for (int k = 0; k < 3; k++)
+			desc.triangles[i].v[k] = remap[desc.triangles[i].v[k]];
+}
+
+bool parse_p3f(const char* name, SceneDesc& desc)
+{
+	MappedFile file;
+	if (!file.Open(name))
+		return false;
+
+	const char* begin = file.data;
+	const char* end = file.data + file.size;
+
+	int numChunks = MIN(thread::hardware_concurrency(), file.size / P3F_MIN_CHUNK);
+	if (numChunks < 1) numChunks = 1;
+
+	// chunk boundaries: the first record start after each equal split point
+	vector<const char*> bounds;
+	bounds.push_back(begin);
+	for (int i = 1; i < numChunks; i++) {
+		const char* p = begin + file.size * i / numChunks;
+		if (p < bounds.back()) p = bounds.back();
+		while (p < end) {
+			while (p < end && *p != '\n') p++;
+			if (p < end) p++;
+			if (isRecordStart(p, end)) break;
+		}
+		bounds.push_back(p);
+	}
+	bounds.push_back(end);
+
+	vector<P3FChunk> chunks(numChunks);
+	vector<thread> workers;
+	for (int i = 1; i < numChunks; i++)
+		workers.push_back(thread(parseChunk, bounds[i], bounds[i + 1], ref(chunks[i])));
+	parseChunk(bounds[0], bounds[1], chunks[0]);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	int lastMaterial = P3B_NO_MATERIAL;
+	for (int i = 0; i < numChunks; i++) {
+		mergeChunk(desc, chunks[i], lastMaterial);
+		if (chunks[i].stopped) break;
+	}
+	if (numChunks > 1)
+		weld_vertices(desc);
+
+	desc.view();   // update the counts in the header
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////// P3B binary format
+
+bool is_p3b(const char* name)
+{
+	const char* ext = strrchr(name, '.');
+	return ext != NULL && strcmp(ext, ".p3b") == 0;
+}
+
+static bool writeArray(FILE* file, const void* data, size_t elementSize, size_t count)
+{
+	return count == 0 || fwrite(data, elementSize, count, file) == count;
+}
+
+bool save_p3b(const char* name, SceneDesc& desc)
+{
+	SceneView v = desc.view();
+
+	FILE* file = fopen(name, "wb");
+	if (file == NULL) return false;
+
+	const P3BHeader& h = desc.header;
+	bool ok = fwrite(&h, sizeof(h), 1, file) == 1 &&
+		writeArray(file, v.materials, sizeof(P3BMaterial), h.numMaterials) &&
+		writeArray(file, v.lights, sizeof(P3BLight), h.numLights) &&
+		writeArray(file, v.vertices, 3 * sizeof(float), h.numVertices) &&
+		writeArray(file, v.triangles, sizeof(P3BTriangle), h.numTriangles) &&
+		writeArray(file, v.spheres, sizeof(P3BSphere), h.numSpheres) &&
+		writeArray(file, v.boxes, sizeof(P3BBox), h.numBoxes) &&
+		writeArray(file, v.planes, sizeof(P3BPlane), h.numPlanes) &&
+		writeArray(file, v.order, sizeof(uint32_t), h.numObjects);
+
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+// FNV-1a over the 4 byte fields that make up every record
+static uint64_t hashWords(uint64_t h, const void* data, size_t bytes)
+{
+	const uint32_t* w = (const uint32_t*)data;
+	for (size_t i = 0; i < bytes / 4; i++) {
+		h ^= w[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+uint64_t hash_scene(const SceneView& view)
+{
+	const P3BHeader& h = *view.header;
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	hash = hashWords(hash, &h, sizeof(h));
+	hash = hashWords(hash, view.materials, (size_t)h.numMaterials * sizeof(P3BMaterial));
+	hash = hashWords(hash, view.lights, (size_t)h.numLights * sizeof(P3BLight));
+	hash = hashWords(hash, view.vertices, (size_t)h.numVertices * 3 * sizeof(float));
+	hash = hashWords(hash, view.triangles, (size_t)h.numTriangles * sizeof(P3BTriangle));
+	hash = hashWords(hash, view.spheres, (size_t)h.numSpheres * sizeof(P3BSphere));
+	hash = hashWords(hash, view.boxes, (size_t)h.numBoxes * sizeof(P3BBox));
+	hash = hashWords(hash, view.planes, (size_t)h.numPlanes * sizeof(P3BPlane));
+	hash = hashWords(hash, view.order, (size_t)h.numObjects * sizeof(uint32_t));
+	return hash;
+}
+
+// Points the view into the mapped file, after checking that every array fits in it
+bool view_p3b(const MappedFile& file, SceneView& view)
+{
+	if (file.size < sizeof(P3BHeader)) return false;
+
+	const P3BHeader* h = (const P3BHeader*)file.data;
+	if (h->magic != P3B_MAGIC || h->version != P3B_VERSION) return false;
+
+	size_t offset = sizeof(P3BHeader);
+	auto take = [&](size_t bytes) -> const char* {
+		const char* p = file.data + offset;
+		offset += bytes;
+		return p;
+	};
+
+	view.header = h;
+	view.materials = (const P3BMaterial*)take((size_t)h->numMaterials * sizeof(P3BMaterial));
+	view.lights = (const P3BLight*)take((size_t)h->numLights * sizeof(P3BLight));
+	view.vertices = (const float*)take((size_t)h->numVertices * 3 * sizeof(float));
+	view.triangles = (const P3BTriangle*)take((size_t)h->numTriangles * sizeof(P3BTriangle));
+	view.spheres = (const P3BSphere*)take((size_t)h->numSpheres * sizeof(P3BSphere));
+	view.boxes = (const P3BBox*)take((size_t)h->numBoxes * sizeof(P3BBox));
+	view.planes = (const P3BPlane*)take((size_t)h->numPlanes * sizeof(P3BPlane));
+	view.order = (const uint32_t*)take((size_t)h->numObjects * sizeof(uint32_t));
+
+	return offset <= file.size;
+}
@@ -0,0 +1,123 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+using namespace std;
+
+// Scene description as flat arrays of plain records. The .p3f parser produces it, the .p3b binary
+// format stores it as is, and Scene::Build() turns either one into objects, so both formats give
+// exactly the same scene.
+//
+// .p3b layout: a P3BHeader followed by the arrays, in the order of the counts in the header.
+// Every record is made of 4 byte fields, so the arrays can be used straight from a mapped file.
+
+#define P3B_MAGIC 0x42443350   // "P3DB"
+#define P3B_VERSION 1
+
+#define P3B_NO_MATERIAL -1
+
+// Objects keep the order of the .p3f file: the top bits of an order entry give the type,
+// the others the index in the array of that type
+typedef enum { P3B_TRIANGLE, P3B_SPHERE, P3B_BOX, P3B_PLANE } P3BObjectType;
+#define P3B_TYPE_SHIFT 28
+#define P3B_INDEX_MASK ((1u << P3B_TYPE_SHIFT) - 1)
+
+struct P3BCamera {
+	float from[3], at[3], up[3];
+	float fov, hither, aperture, focal;
+	int32_t resX, resY;
+};
+
+struct P3BMaterial {
+	float diffColor[3], Kd, specColor[3], Ks, shine, T, ior;
+};
+
+struct P3BLight {
+	float position[3], color[3];
+};
+
+struct P3BTriangle {
+	uint32_t v[3];   // indices in the vertex array
+	int32_t material;
+};
+
+struct P3BSphere {
+	float center[3], radius;
+	int32_t material;
+};
+
+struct P3BBox {
+	float min[3], max[3];
+	int32_t material;
+};
+
+struct P3BPlane {
+	float points[3][3];
+	int32_t material;
+};
+
+struct P3BHeader {
+	uint32_t magic, version;
+	uint32_t hasCamera;
+	P3BCamera camera;
+	float bgColor[3];
+	char skybox[256];   // empty without "env"
+	uint32_t numMaterials, numLights, numVertices, numTriangles, numSpheres, numBoxes, numPlanes, numObjects;
+};
+
+// Read-only view of a scene description: points into a SceneDesc or into a mapped .p3b file
+struct SceneView {
+	const P3BHeader* header;
+	const P3BMaterial* materials;
+	const P3BLight* lights;
+	const float* vertices;   // 3 floats per vertex
+	const P3BTriangle* triangles;
+	const P3BSphere* spheres;
+	const P3BBox* boxes;
+	const P3BPlane* planes;
+	const uint32_t* order;
+};
+
+// Scene description owning its arrays, filled by the .p3f parser
+struct SceneDesc {
+	P3BHeader header;
+	vector<P3BMaterial> materials;
+	vector<P3BLight> lights;
+	vector<float> vertices;
+	vector<P3BTriangle> triangles;
+	vector<P3BSphere> spheres;
+	vector<P3BBox> boxes;
+	vector<P3BPlane> planes;
+	vector<uint32_t> order;
+
+	SceneDesc();
+	SceneView view();
+};
+
+// Read-only memory mapping of a whole file (read into memory where mmap is not available)
+class MappedFile
+{
+public:
+	MappedFile() : data(NULL), size(0) {}
+	~MappedFile();
+
+	bool Open(const char* name);
+	void Close();
+
+	const char* data;
+	size_t size;
+
+private:
+	bool mapped = false;
+};
+
+bool parse_p3f(const char* name, SceneDesc& desc);   // welds equal vertices
+bool save_p3b(const char* name, SceneDesc& desc);
+bool view_p3b(const MappedFile& file, SceneView& view);
+bool is_p3b(const char* name);
+uint64_t hash_scene(const SceneView& view);   // of the whole description, to key caches built from it
+
+#endif
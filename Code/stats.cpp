@@ -0,0 +1,46 @@
+#include <vector>
+#include <mutex>
+
+#include "stats.h"
+
+using namespace std;
+
+static mutex registryMutex;
+static vector<RayStats*> registry;   // counters of every thread that ever traced a ray
+
+RayStats& RayStats::local()
+{
+	thread_local RayStats* stats = NULL;
+
+	if (stats == NULL) {
+		stats = new RayStats();
+		unique_lock<mutex> lock(registryMutex);
+		registry.push_back(stats);
+	}
+	return *stats;
+}
+
+RayStats RayStats::total()
+{
+	RayStats sum;
+	unique_lock<mutex> lock(registryMutex);
+
+	for (size_t i = 0; i < registry.size(); i++) {
+		sum.rays += registry[i]->rays;
+		sum.shadowRays += registry[i]->shadowRays;
+		sum.objectTests += registry[i]->objectTests;
+		sum.cells += registry[i]->cells;
+		sum.shadowCells += registry[i]->shadowCells;
+		sum.shadowTests += registry[i]->shadowTests;
+		sum.mailboxSkips += registry[i]->mailboxSkips;
+	}
+	return sum;
+}
+
+void RayStats::reset()
+{
+	unique_lock<mutex> lock(registryMutex);
+
+	for (size_t i = 0; i < registry.size(); i++)
+		*registry[i] = RayStats();
+}
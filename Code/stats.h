@@ -0,0 +1,23 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Ray tracing counters. Every thread increments its own copy (RayStats::local()),
+// so the hot paths never share a cache line; the copies are summed after a render.
+
+struct RayStats
+{
+	uint64_t rays = 0;         // primary and secondary rays traced
+	uint64_t shadowRays = 0;
+	uint64_t objectTests = 0;   // ray/object intersection tests done by the accelerators
+	uint64_t cells = 0;         // grid cells visited by the rays, shadow rays excepted
+	uint64_t shadowCells = 0;   // grid cells or BVH nodes visited by shadow rays
+	uint64_t shadowTests = 0;   // the part of objectTests done by shadow rays
+	uint64_t mailboxSkips = 0;  // grid tests avoided because the ray had already tested the object
+
+	static RayStats& local(void);   // counters of the calling thread
+	static RayStats total(void);    // sum over all threads
+	static void reset(void);        // only call while no thread is tracing
+};
+#endif
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "threadPool.h"
+
+// pool and deque index of the calling thread, so tasks spawned by a task stay local
+static thread_local ThreadPool* currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(int numThreads) : queued(0), pending(0), idle(0)
+{
+	if (numThreads < 1) numThreads = 1;
+
+	for (int i = 0; i < numThreads; i++)
+		queues.push_back(new WorkQueue());
+
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		unique_lock<mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+void ThreadPool::addTask(function<void()> task)
+{
+	int index;
+
+	if (currentPool == this)
+		index = currentWorker;
+	else {
+		index = nextQueue;
+		nextQueue = (nextQueue + 1) % queues.size();
+	}
+
+	pending++;
+	{
+		unique_lock<mutex> lock(sleepMutex);
+		queued++;
+	}
+	{
+		unique_lock<mutex> lock(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+	taskAvailable.notify_one();
+}
+
+bool ThreadPool::needsWork()
+{
+	if (idle == 0) return false;
+	if (currentPool != this) return true;
+
+	unique_lock<mutex> lock(queues[currentWorker]->lock);
+	return queues[currentWorker]->tasks.empty();
+}
+
+void ThreadPool::wait()
+{
+	unique_lock<mutex> lock(sleepMutex);
+	allDone.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::parallelFor(int count, function<void(int, int)> body)
+{
+	int ranges = workers.size() > 1 ? min(count, 4 * (int)workers.size()) : 1;
+	if (ranges <= 1 || currentPool == this) {   // wait() would never return inside a task
+		if (count > 0) body(0, count);
+		return;
+	}
+
+	for (int i = 0; i < ranges; i++) {
+		int begin = (int)((long long)count * i / ranges), end = (int)((long long)count * (i + 1) / ranges);
+		addTask([=] { body(begin, end); });
+	}
+	wait();
+}
+
+void ThreadPool::resetTimes()
+{
+	for (size_t i = 0; i < queues.size(); i++) {
+		queues[i]->busy = 0.0;
+		queues[i]->executed = 0;
+		queues[i]->stolen = 0;
+	}
+}
+
+void ThreadPool::printTimes(double elapsed)
+{
+	double totalBusy = 0.0;
+
+	for (size_t i = 0; i < queues.size(); i++) {
+		WorkQueue* q = queues[i];
+		printf("Thread %2d: busy %9.1f ms  idle %9.1f ms  tasks %5d  stolen %5d\n",
+			(int)i, q->busy, max(0.0, elapsed - q->busy), q->executed, q->stolen);
+		totalBusy += q->busy;
+	}
+	printf("Thread utilization: %.1f%%\n", 100.0 * totalBusy / (elapsed * queues.size()));
+}
+
+bool ThreadPool::popTask(int index, function<void()>& task)
+{
+	WorkQueue* q = queues[index];
+	unique_lock<mutex> lock(q->lock);
+
+	if (q->tasks.empty()) return false;
+
+	task = q->tasks.back();
+	q->tasks.pop_back();
+	queued--;
+	return true;
+}
+
+bool ThreadPool::stealTask(int index, function<void()>& task)
+{
+	for (size_t i = 1; i < queues.size(); i++) {
+		WorkQueue* victim = queues[(index + i) % queues.size()];
+		unique_lock<mutex> lock(victim->lock);
+
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			queued--;
+			queues[index]->stolen++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+	currentPool = this;
+	currentWorker = index;
+
+	while (true) {
+		function<void()> task;
+
+		if (popTask(index, task) || stealTask(index, task)) {
+			auto start = chrono::high_resolution_clock::now();
+			task();
+			auto end = chrono::high_resolution_clock::now();
+
+			queues[index]->busy += chrono::duration<double, milli>(end - start).count();
+			queues[index]->executed++;
+
+			if (--pending == 0) {
+				unique_lock<mutex> lock(sleepMutex);
+				allDone.notify_all();
+			}
+			continue;
+		}
+
+		// nothing to pop or steal: sleep until a task is queued
+		unique_lock<mutex> lock(sleepMutex);
+		idle++;
+		taskAvailable.wait(lock, [this] { return stopping || queued > 0; });
+		idle--;
+
+		if (stopping && queued == 0)
+			return;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+// Work-stealing thread pool: every worker owns a deque of tasks. A worker pops its own
+// tasks from the back (LIFO) and, when it runs dry, steals from the front of another
+// worker's deque (FIFO), so the oldest and largest pieces of work move between threads.
+
+class ThreadPool
+{
+public:
+	ThreadPool(int numThreads);
+	~ThreadPool(void);
+
+	int getNumThreads() { return workers.size(); }
+	int getNumIdle() { return idle; }   // workers with nothing to do right now
+
+	void addTask(function<void()> task);  // from a worker the task goes to its own deque
+	bool needsWork(void);  // a worker is idle and the caller has no queued task left to give it
+	void wait(void);   // blocks until every submitted task has finished
+
+	// Runs body over [0, count) split into ranges, a few per thread, and waits for them. Called
+	// from a task of the pool, it runs the whole range on that thread.
+	void parallelFor(int count, function<void(int begin, int end)> body);
+
+	void resetTimes(void);
+	void printTimes(double elapsed);   // busy/idle time of each worker over the last elapsed ms
+
+private:
+	struct WorkQueue {
+		deque<function<void()> > tasks;
+		mutex lock;
+		double busy = 0.0;   // ms spent running tasks
+		int executed = 0;
+		int stolen = 0;
+	};
+
+	vector<thread> workers;
+	vector<WorkQueue*> queues;
+	int nextQueue = 0;   // round robin for tasks added from outside the pool
+
+	atomic<int> queued;   // tasks waiting in some deque
+	atomic<int> pending;  // tasks submitted but not yet finished
+	atomic<int> idle;
+	bool stopping = false;
+
+	mutex sleepMutex;
+	condition_variable taskAvailable;
+	condition_variable allDone;
+
+	void workerLoop(int index);
+	bool popTask(int index, function<void()>& task);
+	bool stealTask(int index, function<void()>& task);
+};
+#endif